@@ -0,0 +1,139 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "arena.h"
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wlr/util/log.h"
+
+struct turtile_arena_block {
+    struct turtile_arena_block *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+void *arena_alloc(struct turtile_arena *arena, size_t size) {
+    struct turtile_arena_block *block = arena->blocks;
+    size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    if (!block || block->size - block->used < size) {
+        size_t block_size = block ? block->size * 2 : ARENA_BLOCK_SIZE;
+        while (block_size < size)
+            block_size *= 2;
+        block = malloc(sizeof(*block) + block_size);
+        if (!block) {
+            wlr_log(WLR_ERROR, "Failed to allocate an arena block");
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->size = block_size;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+void *arena_array(struct turtile_arena *arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size)
+        return NULL;
+    return arena_alloc(arena, count * size);
+}
+
+/**
+ * FNV-1a hash of a string.
+ */
+static size_t string_hash(const char *string) {
+    uint32_t hash = 2166136261u;
+    for (; *string; string++)
+        hash = (hash ^ (unsigned char)*string) * 16777619u;
+    return hash;
+}
+
+static const char **string_slot(const char **strings, size_t size,
+                                const char *string) {
+    size_t mask = size - 1;
+    size_t i = string_hash(string) & mask;
+
+    while (strings[i] && strcmp(strings[i], string) != 0)
+        i = (i + 1) & mask;
+    return &strings[i];
+}
+
+/**
+ * Doubles the set of interned strings. The old set stays in the arena until
+ * it is freed, like everything else.
+ */
+static bool grow_strings(struct turtile_arena *arena) {
+    size_t size = arena->strings_size ? arena->strings_size * 2 : 64;
+    const char **strings = arena_array(arena, size, sizeof(*strings));
+    if (!strings)
+        return false;
+
+    for (size_t i = 0; i < arena->strings_size; i++) {
+        if (arena->strings[i])
+            *string_slot(strings, size, arena->strings[i]) = arena->strings[i];
+    }
+    arena->strings = strings;
+    arena->strings_size = size;
+    return true;
+}
+
+const char *arena_intern(struct turtile_arena *arena, const char *string) {
+    if (!string)
+        return NULL;
+
+    // Kept at most half full
+    if ((arena->strings_count + 1) * 2 > arena->strings_size &&
+        !grow_strings(arena))
+        return NULL;
+
+    const char **slot = string_slot(arena->strings, arena->strings_size, string);
+    if (!*slot) {
+        size_t length = strlen(string) + 1;
+        char *copy = arena_alloc(arena, length);
+        if (!copy)
+            return NULL;
+        memcpy(copy, string, length);
+        *slot = copy;
+        arena->strings_count++;
+    }
+    return *slot;
+}
+
+void arena_finish(struct turtile_arena *arena) {
+    struct turtile_arena_block *block = arena->blocks;
+    while (block) {
+        struct turtile_arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_ARENA_H
+#define TURTILE_ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 16384 // first block, later ones double
+
+struct turtile_arena_block;
+
+/**
+ * Bump allocator for data that is freed all at once, such as one generation
+ * of the config. Equal strings are interned so that they are stored once.
+ */
+struct turtile_arena {
+    struct turtile_arena_block *blocks; // the current block first
+    const char **strings; // open addressing set of the interned strings
+    size_t strings_size;
+    size_t strings_count;
+};
+
+/**
+ * Allocates zeroed memory aligned for any type.
+ *
+ * @param arena The arena, zero-initialized before the first allocation.
+ * @param size The size to allocate.
+ * @return The memory, or NULL on failure.
+ */
+void *arena_alloc(struct turtile_arena *arena, size_t size);
+
+/**
+ * Allocates a zeroed array.
+ *
+ * @param arena The arena.
+ * @param count The number of elements, may be 0.
+ * @param size The size of an element.
+ * @return The array, or NULL on failure.
+ */
+void *arena_array(struct turtile_arena *arena, size_t count, size_t size);
+
+/**
+ * Returns the copy in the arena of a string, made the first time the string
+ * is interned.
+ *
+ * @param arena The arena.
+ * @param string The string to intern, may be NULL.
+ * @return The interned string, NULL on failure or if |string| is NULL.
+ */
+const char *arena_intern(struct turtile_arena *arena, const char *string);
+
+/**
+ * Frees everything allocated from the arena. The arena is zeroed and may be
+ * used again.
+ *
+ * @param arena The arena.
+ */
+void arena_finish(struct turtile_arena *arena);
+
+#endif // TURTILE_ARENA_H
@@ -20,172 +20,619 @@
    ----------------------------------------------------------------------------
 */
 #include "commands.h"
-#include "socket_server.h"
+#include "events.h"
+#include "json_reader.h"
+#include "src/ipc.h"
+#include "src/output.h"
 #include "src/server.h"
 #include "src/toplevel.h"
 #include "src/workspace.h"
 #include "wlr/util/log.h"
+#include <ctype.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wayland-util.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_xdg_shell.h>
-#include <json-c/json.h>
 
 // Declare functions so that they can be referenced in the list |commands|
-void exit_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context);
-void window_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context);
-void window_list_command(char *tokens[], int ntokens, char *response,
-						 struct turtile_context *context);
-void window_switch_command(char *tokens[], int ntokens, char *response,
-						   struct turtile_context *context);
-void window_cycle_command(char *tokens[], int ntokens, char *response,
-						  struct turtile_context *context);
-void window_kill_command(char *tokens[], int ntokens, char *response,
-						 struct turtile_context *context);
-void window_move_to_command(char *tokens[], int ntokens, char *response,
-							struct turtile_context *context);
-void window_master_toggle_command(char *tokens[], int ntokens, char *response,
-								  struct turtile_context *context);
-void workspace_command(char *tokens[], int ntokens, char *response,
-					   struct turtile_context *context);
-void workspace_list_command(char *tokens[], int ntokens, char *response,
-							struct turtile_context *context);
-void workspace_switch_command(char *tokens[], int ntokens, char *response,
-							  struct turtile_context *conntext);
+void exit_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void batch_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void tree_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void apply_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_list_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_switch_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_cycle_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_kill_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_move_to_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void window_master_toggle_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void workspace_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void workspace_list_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void workspace_switch_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *conntext);
+void process_list_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+void config_reload_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context);
+
 typedef struct {
-    char *cmd_name;
-    char *subcmd_name;
-    void (*cmd_fun)(char *tokens[], int ntokens, char *response,
-                   struct turtile_context *context);
+    const char *cmd_name;
+    const char *subcmd_name;
+    command_func_t cmd_fun;
+    uint32_t flags;
 } command_t;
 
-// List of commands with their associated functions 
-static command_t commands[] = {
-    {"exit", NULL, exit_command},
-    {"window", "list", window_list_command},
-    {"window", "switch", window_switch_command},
-    {"window", "cycle", window_cycle_command},
-    {"window", "kill", window_kill_command},
-    {"window", "move-to", window_move_to_command},
-    {"window", "mtoggle", window_master_toggle_command},
-    {"window", NULL, window_command},
-    {"workspace", "list", workspace_list_command},
-    {"workspace", "switch", workspace_switch_command},
-    {"workspace", NULL, workspace_command},
-    {NULL, NULL, NULL} // Terminate array with NULLs
+// List of built-in commands with their associated functions
+static const command_t builtin_commands[] = {
+    {"exit", NULL, exit_command, 0},
+    {"batch", NULL, batch_command, COMMAND_RAW_ARGS},
+    {"tree", NULL, tree_command, 0},
+    {"apply", NULL, apply_command, COMMAND_RAW_ARGS},
+    {"window", "list", window_list_command, 0},
+    {"window", "switch", window_switch_command, 0},
+    {"window", "cycle", window_cycle_command, 0},
+    {"window", "kill", window_kill_command, 0},
+    {"window", "move-to", window_move_to_command, 0},
+    {"window", "mtoggle", window_master_toggle_command, 0},
+    {"window", NULL, window_command, 0},
+    {"workspace", "list", workspace_list_command, 0},
+    {"workspace", "switch", workspace_switch_command, 0},
+    {"workspace", NULL, workspace_command, 0},
+    {"process", "list", process_list_command, 0},
+    {"config", "reload", config_reload_command, 0},
 };
 
+#define COMMAND_TABLE_MIN_SIZE 64 // always a power of two
+#define TOKEN_DELIMITERS " \n\t"
+
+// Open addressing hash table of the registered commands, keyed on the
+// command and subcommand names. Kept at most half full.
+static command_t *command_table;
+static size_t command_table_size;
+static size_t command_count;
+
+// Reply of the last internal command, kept to reuse its memory
+static struct turtile_buffer internal_reply;
+
 /**
- * Execute a subcommand with the given tokens and context.
- *
- * @param tokens       An array of tokens representing the subcommand and
- *                     its arguments.
- * @param ntokens      The number of tokens in the tokens array.
- * @param response     A buffer to store the response to the subcommand.
- * @param context      A pointer to the turtile context structure.
- * @param subcommands  A pointer to the subcommands array.
+ * FNV-1a hash of a command and subcommand name.
+ */
+static size_t command_hash(const char *cmd_name, const char *subcmd_name) {
+	uint32_t hash = 2166136261u;
+
+	for (const char *c = cmd_name; *c; c++)
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	if (subcmd_name) {
+		hash = (hash ^ ' ') * 16777619u;
+		for (const char *c = subcmd_name; *c; c++)
+			hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * Find the slot of a command in the table, or the empty slot where it would
+ * be inserted.
+ */
+static command_t *command_slot(command_t *table, size_t size,
+							   const char *cmd_name, const char *subcmd_name) {
+	size_t mask = size - 1;
+	size_t i = command_hash(cmd_name, subcmd_name) & mask;
+
+	while (table[i].cmd_name != NULL) {
+		bool same_subcmd = subcmd_name == NULL || table[i].subcmd_name == NULL ?
+			subcmd_name == table[i].subcmd_name :
+			strcmp(table[i].subcmd_name, subcmd_name) == 0;
+		if (same_subcmd && strcmp(table[i].cmd_name, cmd_name) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+	return &table[i];
+}
+
+static const command_t *find_command(const char *cmd_name,
+									 const char *subcmd_name) {
+	if (command_table == NULL)
+		return NULL;
+
+	command_t *slot = command_slot(command_table, command_table_size,
+								   cmd_name, subcmd_name);
+	return slot->cmd_name ? slot : NULL;
+}
+
+/**
+ * Double the size of the command table and rehash every command.
  */
-void execute_subcommand(char *tokens[], int ntokens, char *response,
-                        struct turtile_context *context,
-						command_t *subcommands);
+static bool grow_command_table(void) {
+	size_t size = command_table_size ?
+		command_table_size * 2 : COMMAND_TABLE_MIN_SIZE;
+	command_t *table = calloc(size, sizeof(*table));
+	if (!table)
+		return false;
+
+	for (size_t i = 0; i < command_table_size; i++) {
+		command_t *command = &command_table[i];
+		if (command->cmd_name)
+			*command_slot(table, size, command->cmd_name,
+						  command->subcmd_name) = *command;
+	}
+	free(command_table);
+	command_table = table;
+	command_table_size = size;
+	return true;
+}
+
+bool commands_register(const char *cmd_name, const char *subcmd_name,
+					   command_func_t func, uint32_t flags) {
+	if ((command_count + 1) * 2 > command_table_size && !grow_command_table()) {
+		wlr_log(WLR_ERROR, "Failed to allocate the command table");
+		return false;
+	}
+
+	command_t *slot = command_slot(command_table, command_table_size,
+								   cmd_name, subcmd_name);
+	if (slot->cmd_name) {
+		wlr_log(WLR_ERROR, "Command %s %s is already registered", cmd_name,
+				subcmd_name ? subcmd_name : "");
+		return false;
+	}
+	*slot = (command_t){cmd_name, subcmd_name, func, flags};
+	command_count++;
+	return true;
+}
+
+void commands_init(void) {
+	size_t n = sizeof(builtin_commands) / sizeof(builtin_commands[0]);
+	for (size_t i = 0; i < n; i++) {
+		const command_t *command = &builtin_commands[i];
+		commands_register(command->cmd_name, command->subcmd_name,
+						  command->cmd_fun, command->flags);
+	}
+}
+
+void commands_finish(void) {
+	buffer_finish(&internal_reply);
+	free(command_table);
+	command_table = NULL;
+	command_table_size = command_count = 0;
+}
 
 /**
- * Splits a string into an array of tokens based on whitespace
- * characters (spaces, tabs, and newlines).
+ * Split the next token off a string, replacing the delimiter that follows it
+ * with a null byte. Unlike strtok, the position is kept by the caller.
  *
- * @param str    The string to split into tokens.
- * @param tokens An array to store the tokens.
- * @return       The number of tokens in the tokens array.
+ * @param cursor Position in the string, advanced past the token.
+ * @return       The token, or NULL if the string has no more tokens.
  */
-int splitString(char *str, char *tokens[]);
+static char *next_token(char **cursor) {
+	char *token = *cursor + strspn(*cursor, TOKEN_DELIMITERS);
+	if (*token == '\0') {
+		*cursor = token;
+		return NULL;
+	}
 
-void execute_command(char *message, char *response,
+	char *end = token + strcspn(token, TOKEN_DELIMITERS);
+	if (*end != '\0')
+		*end++ = '\0';
+	*cursor = end;
+	return token;
+}
+
+void execute_command(char *message, struct json_writer *response,
                      struct turtile_context *context) {
     char *tokens[MAX_MSG_ELEMENTS];
-    int ntokens = splitString(message, tokens);
-
-    for (int i = 0; commands[i].cmd_name != NULL; i++) {
-        if (strcmp(tokens[0], commands[i].cmd_name) == 0) {
-            if (commands[i].subcmd_name == NULL || 
-                (ntokens > 1 && strcmp(tokens[1], commands[i].subcmd_name) == 0)) {
-				// Call function with appropriate parameters
-                commands[i].cmd_fun(tokens + (commands[i].subcmd_name ? 2 : 1), 
-                                    ntokens - (commands[i].subcmd_name ? 2 : 1), 
-                                    response, context);
-                return;
-            }
-        }
+    char *cursor = message;
+    int ntokens = 0;
+
+    if ((tokens[ntokens++] = next_token(&cursor)) == NULL) {
+        reply_error(response, "empty command");
+        return;
+    }
+
+    const command_t *command = find_command(tokens[0], NULL);
+    if (command && command->flags & COMMAND_RAW_ARGS) {
+        // Pass the rest of the message as is, without its leading spaces
+        char *args = cursor + strspn(cursor, TOKEN_DELIMITERS);
+        command->cmd_fun(&args, *args ? 1 : 0, response, context);
+        return;
+    }
+
+    while (ntokens < MAX_MSG_ELEMENTS &&
+           (tokens[ntokens] = next_token(&cursor)) != NULL)
+        ntokens++;
+    if (ntokens == MAX_MSG_ELEMENTS && next_token(&cursor) != NULL) {
+        reply_error(response, "too many tokens in command, the maximum is %d",
+                    MAX_MSG_ELEMENTS);
+        return;
+    }
+
+    // A registered subcommand takes precedence over the command on its own
+    const command_t *subcommand = ntokens > 1 ?
+        find_command(tokens[0], tokens[1]) : NULL;
+    if (subcommand) {
+        subcommand->cmd_fun(tokens + 2, ntokens - 2, response, context);
+    } else if (command) {
+        command->cmd_fun(tokens + 1, ntokens - 1, response, context);
+    } else {
+        reply_error(response, "Unknown command %s", tokens[0]);
     }
-    snprintf(response, MAX_MSG_SIZE, "{\"error\": \"Unknown command %s\"}", message);
 }
-		
-int splitString(char *str, char *tokens[]){
-	int i=1;
 
-    if ((tokens[0]=strtok(str," \n\t"))==NULL)
-        return 0;
-    while ((tokens[i]=strtok(NULL," \n\t"))!=NULL)
-        i++;
+void execute_internal_command(struct turtile_server *server,
+							  const char *command) {
+	struct turtile_context context = {
+		.server = server,
+		.client = NULL,
+	};
+	struct json_writer writer;
+	char message[MAX_MSG_SIZE + 1];
 
-    return i;
+	// Same limit as commands coming from the socket
+	if (strlen(command) > MAX_MSG_SIZE) {
+		wlr_log(WLR_ERROR, "Command too long: %s", command);
+		return;
+	}
+	strcpy(message, command);
+	// The command may belong to a config that a reload frees meanwhile
+	char name[64];
+	snprintf(name, sizeof(name), "%s", command);
+
+	internal_reply.len = 0;
+	internal_reply.failed = false;
+	json_writer_init(&writer, &internal_reply, JSON_WRITER_TEXT);
+	execute_command(message, &writer, &context);
+	if (internal_reply.len > 0 &&
+		strncmp(internal_reply.data, "{\"error\"", 8) == 0)
+		wlr_log(WLR_ERROR, "Command %s failed: %.*s", name,
+				(int)internal_reply.len, internal_reply.data);
+}
+
+void reply_success(struct json_writer *response, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	json_writer_begin_object(response);
+	json_writer_key(response, "success");
+	json_writer_vstringf(response, format, args);
+	json_writer_end_object(response);
+	va_end(args);
 }
 
-void exit_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context){
+void reply_error(struct json_writer *response, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	json_writer_begin_object(response);
+	json_writer_key(response, "error");
+	json_writer_vstringf(response, format, args);
+	json_writer_end_object(response);
+	va_end(args);
+}
+
+/**
+ * Write the members of the object describing a window, without opening or
+ * closing the object.
+ */
+static void write_window_members(struct json_writer *writer,
+								 struct turtile_toplevel *toplevel,
+								 uint32_t fields) {
+	if (fields & WINDOW_FIELD_ID) {
+		json_writer_key(writer, "id");
+		json_writer_string(writer, toplevel->id);
+	}
+	if (fields & WINDOW_FIELD_APP) {
+		json_writer_key(writer, "app");
+		json_writer_string(writer, toplevel->xdg_toplevel->app_id ?
+						   toplevel->xdg_toplevel->app_id : "null");
+	}
+	if (fields & WINDOW_FIELD_TITLE) {
+		json_writer_key(writer, "title");
+		json_writer_string(writer, toplevel->xdg_toplevel->title ?
+						   toplevel->xdg_toplevel->title : "Unnamed");
+	}
+	if (fields & WINDOW_FIELD_WORKSPACE) {
+		json_writer_key(writer, "workspace");
+		json_writer_string(writer, toplevel->workspace->name);
+	}
+	if (fields & WINDOW_FIELD_GEOMETRY) {
+		json_writer_key(writer, "x");
+		json_writer_int(writer, toplevel->geometry.x);
+		json_writer_key(writer, "y");
+		json_writer_int(writer, toplevel->geometry.y);
+		json_writer_key(writer, "width");
+		json_writer_int(writer, toplevel->geometry.width);
+		json_writer_key(writer, "height");
+		json_writer_int(writer, toplevel->geometry.height);
+	}
+}
+
+static void write_window_object(struct json_writer *writer,
+								struct turtile_toplevel *toplevel,
+								uint32_t fields) {
+	json_writer_begin_object(writer);
+	write_window_members(writer, toplevel, fields);
+	json_writer_end_object(writer);
+}
+
+void write_window(struct json_writer *writer, struct turtile_toplevel *toplevel) {
+	// Windows are listed much more often than they change: the object is
+	// serialized again only when the generation of the toplevel moved, which
+	// every change of its title, app_id or workspace does, otherwise the
+	// previous bytes are copied as they are
+	struct turtile_buffer *fragment = &toplevel->fragment[writer->format];
+	uint64_t *fragment_generation =
+		&toplevel->fragment_generation[writer->format];
+
+	if (*fragment_generation != toplevel->generation || fragment->len == 0) {
+		struct json_writer fragment_writer;
+		fragment->len = 0;
+		fragment->failed = false;
+		json_writer_init(&fragment_writer, fragment, writer->format);
+		write_window_object(&fragment_writer, toplevel, WINDOW_FIELDS_DEFAULT);
+		if (fragment->failed) {
+			fragment->len = 0;
+			write_window_object(writer, toplevel, WINDOW_FIELDS_DEFAULT);
+			return;
+		}
+		*fragment_generation = toplevel->generation;
+	}
+	json_writer_raw(writer, fragment->data, fragment->len);
+}
+
+void write_window_fields(struct json_writer *writer,
+						 struct turtile_toplevel *toplevel, uint32_t fields) {
+	if (fields == WINDOW_FIELDS_DEFAULT)
+		write_window(writer, toplevel);
+	else
+		write_window_object(writer, toplevel, fields);
+}
+
+/**
+ * Consume the value of the option at tokens[*i].
+ *
+ * @return The value, or NULL after writing the error reply if it is missing.
+ */
+static char *option_value(char *tokens[], int ntokens, int *i,
+						  struct json_writer *response) {
+	if (*i + 1 >= ntokens) {
+		reply_error(response, "missing value for %s", tokens[*i]);
+		return NULL;
+	}
+	return tokens[++*i];
+}
+
+/**
+ * Parse a comma separated list of field names into a bitmask, where the
+ * field names[i] is the bit 1 << i.
+ *
+ * @return false, after writing the error reply, if a field is unknown.
+ */
+static bool parse_fields(char *list, const char *const names[], int nnames,
+						 uint32_t *fields, struct json_writer *response) {
+	char *saveptr;
+
+	*fields = 0;
+	for (char *name = strtok_r(list, ",", &saveptr); name;
+		 name = strtok_r(NULL, ",", &saveptr)) {
+		int i = 0;
+		while (i < nnames && strcmp(names[i], name) != 0)
+			i++;
+		if (i == nnames) {
+			reply_error(response, "unknown field %s", name);
+			return false;
+		}
+		*fields |= 1u << i;
+	}
+	if (*fields == 0) {
+		reply_error(response, "missing argument: fields");
+		return false;
+	}
+	return true;
+}
+
+void batch_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
+	// Execute a list of commands separated by ';' or newlines inside a single
+	// transaction, so the layout is recomputed only once at the end. The
+	// batch is a single request of at most MAX_MSG_SIZE bytes, about 2000
+	// window move-to commands.
+	struct turtile_server *server = context->server;
+	int nresults = 0;
+
+	// Every command writes its result straight into the array
+	json_writer_begin_array(response);
+	server_begin_transaction(server);
+	char *command = ntokens > 0 ? tokens[0] : NULL;
+	while (command != NULL) {
+		char *end = strpbrk(command, ";\n");
+		if (end != NULL)
+			*end = '\0';
+
+		if (command[strspn(command, " \t")] != '\0') {
+			execute_command(command, response, context);
+			nresults++;
+		}
+		command = end ? end + 1 : NULL;
+	}
+	server_commit_transaction(server);
+
+	if (nresults == 0)
+		reply_error(response, "missing argument: commands");
+	json_writer_end_array(response);
+}
+
+void exit_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	struct turtile_server *server = context->server;
     wl_display_terminate(server->wl_display);
-    snprintf(response, MAX_MSG_SIZE, "Exiting turtile\n");
+    reply_success(response, "Exiting turtile");
 }
 
-void window_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context){
+void window_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	// TODO: use this function as a help for the other window subcommands
-    snprintf(response, MAX_MSG_SIZE,
-			 "TODO: placeholder for window command help\n");
+    json_writer_string(response, "TODO: placeholder for window command help");
 }
 
-void window_list_command(char *tokens[], int ntokens, char *response,
-						 struct turtile_context *context) {
+/**
+ * Check a window against the window list filters, NULL matches anything.
+ */
+static bool window_matches(struct turtile_toplevel *toplevel,
+						   struct turtile_workspace *workspace,
+						   const char *app_id) {
+	if (!toplevel->xdg_toplevel)
+		return false;
+	if (workspace && toplevel->workspace != workspace)
+		return false;
+	return !app_id || (toplevel->xdg_toplevel->app_id &&
+					   strcmp(toplevel->xdg_toplevel->app_id, app_id) == 0);
+}
+
+/**
+ * Write the windows added, changed and removed since a generation, or every
+ * window with "full" set when the removals since then have been forgotten.
+ */
+static void write_window_delta(struct json_writer *response,
+							   struct turtile_server *server,
+							   uint64_t since, uint32_t fields) {
+	// A generation from the future was handed out by a previous instance
+	bool full = since < server->removed_windows_horizon ||
+		since > server->generation;
+	if (full)
+		since = 0;
+
+	json_writer_begin_object(response);
+	json_writer_key(response, "generation");
+	json_writer_int(response, server->generation);
+	json_writer_key(response, "full");
+	json_writer_bool(response, full);
+
+	struct turtile_toplevel *toplevel;
+	json_writer_key(response, "added");
+	json_writer_begin_array(response);
+	wl_list_for_each(toplevel, &server->toplevels, link) {
+		if (toplevel->xdg_toplevel && toplevel->created_generation > since)
+			write_window_fields(response, toplevel, fields);
+	}
+	json_writer_end_array(response);
+
+	json_writer_key(response, "changed");
+	json_writer_begin_array(response);
+	wl_list_for_each(toplevel, &server->toplevels, link) {
+		if (toplevel->xdg_toplevel && toplevel->created_generation <= since &&
+			toplevel->generation > since)
+			write_window_fields(response, toplevel, fields);
+	}
+	json_writer_end_array(response);
+
+	json_writer_key(response, "removed");
+	json_writer_begin_array(response);
+	for (size_t i = 0; i < REMOVED_WINDOWS_MAX && !full; i++) {
+		struct turtile_removed_window *removed = &server->removed_windows[
+			(server->removed_windows_next + i) % REMOVED_WINDOWS_MAX];
+		if (removed->generation > since)
+			json_writer_string(response, removed->id);
+	}
+	json_writer_end_array(response);
+	json_writer_end_object(response);
+}
+
+void window_list_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context) {
+    // Same order as the bits of enum window_fields
+    static const char *const field_names[] = {"id", "app", "title", "workspace",
+                                              "geometry"};
     struct turtile_server *server = context->server;
+    struct turtile_workspace *workspace = NULL;
+    const char *app_id = NULL;
+    bool focused = false;
+    const char *since = NULL;
+    uint32_t fields = WINDOW_FIELDS_DEFAULT;
+
+    for (int i = 0; i < ntokens; i++) {
+        if (strcmp(tokens[i], "--since") == 0) {
+            if (!(since = option_value(tokens, ntokens, &i, response)))
+                return;
+        } else if (strcmp(tokens[i], "--focused") == 0) {
+            focused = true;
+        } else if (strcmp(tokens[i], "--workspace") == 0) {
+            char *name = option_value(tokens, ntokens, &i, response);
+            if (!name)
+                return;
+            workspace = get_workspace(server, name);
+            if (!workspace) {
+                reply_error(response, "workspace %s not found", name);
+                return;
+            }
+        } else if (strcmp(tokens[i], "--app") == 0) {
+            if (!(app_id = option_value(tokens, ntokens, &i, response)))
+                return;
+        } else if (strcmp(tokens[i], "--fields") == 0) {
+            char *list = option_value(tokens, ntokens, &i, response);
+            if (!list || !parse_fields(list, field_names,
+                                        sizeof(field_names) / sizeof(field_names[0]),
+                                        &fields, response))
+                return;
+        } else {
+            reply_error(response, "invalid argument %s", tokens[i]);
+            return;
+        }
+    }
+
+    if (since) {
+        // Windows leaving the filters would not be reported, only project
+        char *end;
+        uint64_t generation = strtoull(since, &end, 10);
+        if (*end != '\0' || !isdigit((unsigned char)*since)) {
+            reply_error(response, "invalid generation %s", since);
+        } else if (focused || workspace || app_id) {
+            reply_error(response, "--since only supports --fields");
+        } else {
+            write_window_delta(response, server, generation, fields);
+        }
+        return;
+    }
+
     if (!server || wl_list_empty(&server->toplevels)) {
-        response = strdup("{\"error\": \"No windows found\"}\n");
+        reply_error(response, "No windows found");
         return;
     }
 
-    struct json_object *json_response = json_object_new_array();
+    json_writer_begin_array(response);
 
     struct turtile_toplevel *toplevel;
-    
-    wl_list_for_each(toplevel, &server->toplevels, link) {
-        if (toplevel->xdg_toplevel) {
-            const char *title = toplevel->xdg_toplevel->title ?
-				toplevel->xdg_toplevel->title : "Unnamed";
-            const char *app = toplevel->xdg_toplevel->app_id ?
-				toplevel->xdg_toplevel->title : "null";
-
-            // Create a JSON object for each window and populate its fields
-            struct json_object *json_window = json_object_new_object();
-            json_object_object_add(json_window, "id",
-								   json_object_new_string(toplevel->id));
-            json_object_object_add(json_window, "app",
-								   json_object_new_string(app));
-            json_object_object_add(json_window, "title",
-								   json_object_new_string(title));
-            json_object_object_add(json_window, "workspace",
-								   json_object_new_string(toplevel->workspace->name));
-            
-            json_object_array_add(json_response, json_window);
+    if (focused) {
+        // The focused window is the head of the focus list, no need to walk
+        toplevel = get_first_focus_toplevel(server);
+        if (toplevel && window_matches(toplevel, workspace, app_id))
+            write_window_fields(response, toplevel, fields);
+    } else {
+        wl_list_for_each(toplevel, &server->toplevels, link) {
+            if (window_matches(toplevel, workspace, app_id))
+                write_window_fields(response, toplevel, fields);
         }
     }
 
-    strcpy(response, json_object_to_json_string(json_response));
-    json_object_put(json_response);
+    json_writer_end_array(response);
 }
 
-void window_switch_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context){
+void window_switch_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	// Switch focus to designated toplevel
 	struct turtile_server *server = context->server;
 
@@ -196,23 +643,20 @@ void window_switch_command(char *tokens[], int ntokens, char *response,
 		wl_list_for_each(toplevel, &server->focus_toplevels, flink) {
 			if(strcmp(toplevel->id, new_toplevel_id) == 0){
 				focus_toplevel(toplevel, toplevel->xdg_toplevel->base->surface);
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"success\": \"switching focus to: %s\"}",
-						 toplevel->xdg_toplevel->title);
+				reply_success(response, "switching focus to: %s",
+							  toplevel->xdg_toplevel->title);
 				return;
 			}
 		}
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"window %s not found\"}", new_toplevel_id);
+		reply_error(response, "window %s not found", new_toplevel_id);
 
 	} else{
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"missing argument: window id\"}");
+		reply_error(response, "missing argument: window id");
 	}
 }
 
-void window_cycle_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context){
+void window_cycle_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	// Cycle to the next toplevel in the same workspace
 	struct turtile_server *server = context->server;
 
@@ -220,24 +664,22 @@ void window_cycle_command(char *tokens[], int ntokens, char *response,
 	get_workspace_toplevels(server->active_workspace, &workspace_toplevels);
 
 	if (wl_list_empty(&workspace_toplevels)){
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"Workspace is empty\"}");
+		reply_error(response, "Workspace is empty");
 		return;
 	} else if (wl_list_length(&workspace_toplevels) < 2) {
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"Only one current window open\"}");
+		reply_error(response, "Only one current window open");
 		return;
 	} 		
 
 	struct turtile_toplevel *next_toplevel =
 		wl_container_of(workspace_toplevels.next, next_toplevel, auxlink);
 	focus_toplevel(next_toplevel, next_toplevel->xdg_toplevel->base->surface);
-    snprintf(response, MAX_MSG_SIZE, "{\"success\": \"switching focus to: %s\"}",
-			 next_toplevel->xdg_toplevel->title);
+    reply_success(response, "switching focus to: %s",
+    			  next_toplevel->xdg_toplevel->title);
 }
 
-void window_kill_command(char *tokens[], int ntokens, char *response,
-					struct turtile_context *context){
+void window_kill_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	// kill designated toplevel
 	struct turtile_server *server = context->server;
 	struct turtile_toplevel *toplevel;
@@ -248,25 +690,23 @@ void window_kill_command(char *tokens[], int ntokens, char *response,
 		wl_list_for_each(toplevel, &server->focus_toplevels, flink) {
 			if(strcmp(toplevel->id, new_toplevel_id) == 0){
 				kill_toplevel(toplevel);
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"success\": \"kill: %s\"}",
-						 toplevel->xdg_toplevel->title);
+				reply_success(response, "kill: %s",
+							  toplevel->xdg_toplevel->title);
 				return;
 			}
 		}
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"window %s not found\"}", new_toplevel_id);
+		reply_error(response, "window %s not found", new_toplevel_id);
 
 	} else{
 		toplevel = get_first_focus_toplevel(server);
 		kill_toplevel(toplevel);
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"success\": \"kill: %s\"}", toplevel->xdg_toplevel->title);
+		reply_success(response, "kill: %s",
+					  toplevel->xdg_toplevel->title);
 	}
 }
 
-void window_move_to_command(char *tokens[], int ntokens, char *response,
-							struct turtile_context *context){
+void window_move_to_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	struct turtile_server *server = context->server;
 
     if (ntokens >= 1) {
@@ -275,8 +715,7 @@ void window_move_to_command(char *tokens[], int ntokens, char *response,
 			get_workspace(server, target_workspace_name);
 
 		if (!target_workspace) {
-			snprintf(response, MAX_MSG_SIZE,
-					 "{\"error\": \"workspace not found\"}");
+			reply_error(response, "workspace not found");
 			return;
 		}
 
@@ -287,34 +726,34 @@ void window_move_to_command(char *tokens[], int ntokens, char *response,
 			toplevel_to_move = get_toplevel(server, toplevel_id);
 			
 			if (!toplevel_to_move) {
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"error\": \"window %s not found\"}", toplevel_id);
+				reply_error(response, "window %s not found", toplevel_id);
 				return;
 			}
 		} else {
 			toplevel_to_move = get_first_focus_toplevel(server);
 			if (!toplevel_to_move) {
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"error\": \"no focused window to move\"}");
+				reply_error(response, "no focused window to move");
 				return;
 			}
 		}
 		
+		schedule_workspace_cleanup(toplevel_to_move->workspace);
 		toplevel_to_move->workspace = target_workspace;
+		toplevel_to_move->generation = server_bump_generation(server);
 		server_redraw_windows(server);
+		emit_window_event(server, "move", toplevel_to_move);
 		
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"success\": \"moved window %s to workspace %s\"}",
-				 toplevel_to_move->xdg_toplevel->title, target_workspace->name);
+		reply_success(response, "moved window %s to workspace %s",
+					  toplevel_to_move->xdg_toplevel->title,
+					  target_workspace->name);
 
     } else {
-        snprintf(response, MAX_MSG_SIZE,
-                 "{\"error\": \"missing argument: workspace name\"}");
+        reply_error(response, "missing argument: workspace name");
 	}
 }
 
-void window_master_toggle_command(char *tokens[], int ntokens, char *response,
-								  struct turtile_context *context){
+void window_master_toggle_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	// Set designated toplevel as master
 	struct turtile_server *server = context->server;
 	struct turtile_toplevel *toplevel;
@@ -327,13 +766,11 @@ void window_master_toggle_command(char *tokens[], int ntokens, char *response,
 		if(toplevel != NULL){
 			set_master_toplevel(toplevel);
 
-			snprintf(response, MAX_MSG_SIZE,
-					 "{\"success\": \"master: %s\"}",
-					 toplevel->xdg_toplevel->title);
+			reply_success(response, "master: %s",
+						  toplevel->xdg_toplevel->title);
 			return;
 		} else {
-			snprintf(response, MAX_MSG_SIZE,
-					 "{\"error\": \"window %s not found\"}", toplevel_id);
+			reply_error(response, "window %s not found", toplevel_id);
 			return;
 		}
 	} else{
@@ -344,64 +781,86 @@ void window_master_toggle_command(char *tokens[], int ntokens, char *response,
 				get_next_focus_toplevel(server);
 			if(next_toplevel != NULL){
 				set_master_toplevel(get_next_focus_toplevel(server));
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"success\": \"master: %s\"}",
-						 toplevel->xdg_toplevel->title);
+				reply_success(response, "master: %s",
+							  toplevel->xdg_toplevel->title);
 				return;
 			} else {
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"error\": \"the current window is already master\"}");
+				reply_error(response, "the current window is already master");
 				return;
 			}
 		} else if(toplevel != NULL) {
 			set_master_toplevel(toplevel);
-			snprintf(response, MAX_MSG_SIZE,
-					 "{\"success\": \"master: %s\"}",
-					 toplevel->xdg_toplevel->title);
+			reply_success(response, "master: %s",
+						  toplevel->xdg_toplevel->title);
 			return;
 		}
 	}
-	snprintf(response, MAX_MSG_SIZE, "{\"error\": \"no window found\"}");
+	reply_error(response, "no window found");
 }
 
-void workspace_command(char *tokens[], int ntokens, char *response,
-					   struct turtile_context *context){
+void workspace_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	// TODO: use this function as a help for the other workspace subcommands
-    snprintf(response, MAX_MSG_SIZE,
-			 "TODO: placeholder for workspace command help\n");
+    json_writer_string(response, "TODO: placeholder for workspace command help");
 }
 
-void workspace_list_command(char *tokens[], int ntokens, char *response,
-                            struct turtile_context *context) {
+void workspace_list_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context) {
+    enum { FIELD_NAME = 1 << 0, FIELD_ACTIVE = 1 << 1 };
+    static const char *const field_names[] = {"name", "active"};
     struct turtile_server *server = context->server;
+    const char *name = NULL;
+    bool active = false;
+    uint32_t fields = FIELD_NAME | FIELD_ACTIVE;
+
+    for (int i = 0; i < ntokens; i++) {
+        if (strcmp(tokens[i], "--active") == 0) {
+            active = true;
+        } else if (strcmp(tokens[i], "--name") == 0) {
+            if (!(name = option_value(tokens, ntokens, &i, response)))
+                return;
+        } else if (strcmp(tokens[i], "--fields") == 0) {
+            char *list = option_value(tokens, ntokens, &i, response);
+            if (!list || !parse_fields(list, field_names,
+                                        sizeof(field_names) / sizeof(field_names[0]),
+                                        &fields, response))
+                return;
+        } else {
+            reply_error(response, "invalid argument %s", tokens[i]);
+            return;
+        }
+    }
+
     if (!server || wl_list_empty(&server->workspaces)) {
-        response = strdup("{\"error\": \"No workspaces found\"}\n");
+        reply_error(response, "No workspaces found");
         return;
     }
 
-    struct json_object *json_response = json_object_new_array();
+    json_writer_begin_array(response);
 
     struct turtile_workspace *workspace;
     wl_list_for_each(workspace, &server->workspaces, link) {
-        const char *name = workspace->name;
-        bool is_active = (workspace == server->active_workspace);
-
-        // Create a JSON object for each workspace and populate its fields
-        struct json_object *json_workspace = json_object_new_object();
-        json_object_object_add(json_workspace, "name",
-                               json_object_new_string(name));
-        json_object_object_add(json_workspace, "active",
-                               json_object_new_boolean(is_active));
-
-        json_object_array_add(json_response, json_workspace);
+        if (active && workspace != server->active_workspace)
+            continue;
+        if (name && strcmp(workspace->name, name) != 0)
+            continue;
+        json_writer_begin_object(response);
+        if (fields & FIELD_NAME) {
+            json_writer_key(response, "name");
+            json_writer_string(response, workspace->name);
+        }
+        if (fields & FIELD_ACTIVE) {
+            json_writer_key(response, "active");
+            json_writer_bool(response, workspace == server->active_workspace);
+        }
+        json_writer_end_object(response);
     }
 
-    strcpy(response, json_object_to_json_string(json_response));
-    json_object_put(json_response);
+    json_writer_end_array(response);
 }
 
-void workspace_switch_command(char *tokens[], int ntokens, char *response,
-							  struct turtile_context *context){
+void workspace_switch_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context){
 	struct turtile_server *server = context->server;
 
 	if(ntokens >= 1){
@@ -409,25 +868,376 @@ void workspace_switch_command(char *tokens[], int ntokens, char *response,
 		struct turtile_workspace *workspace;
 
 		if(strcmp(server->active_workspace->name, new_workspace_name) == 0){
-            snprintf(response, MAX_MSG_SIZE,
-                     "{\"success\": \"already in workspace %s\"}\n",
-					 new_workspace_name);
+            reply_success(response, "already in workspace %s",
+						  new_workspace_name);
             return;
         }
 		wl_list_for_each(workspace, &server->workspaces, link) {
 			if(strcmp(workspace->name, new_workspace_name) == 0){
 				switch_workspace(workspace);
-				snprintf(response, MAX_MSG_SIZE,
-						 "{\"success\": \"switch to workspace %s\"}",
-						 new_workspace_name);
+				reply_success(response, "switch to workspace %s",
+							  new_workspace_name);
 				return;
 			}
 		}
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"workspace %s not found\"}", new_workspace_name);
+		reply_error(response, "workspace %s not found", new_workspace_name);
 
 	} else{
-		snprintf(response, MAX_MSG_SIZE,
-				 "{\"error\": \"missing argument: workspace name\"}");
+		reply_error(response, "missing argument: workspace name");
+	}
+}
+
+void tree_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context) {
+	// The whole state in one reply, commands run on the compositor thread so
+	// nothing can change while it is written
+	struct turtile_server *server = context->server;
+	struct turtile_toplevel *focused = get_first_focus_toplevel(server);
+	struct turtile_toplevel *toplevel;
+	struct turtile_workspace *workspace;
+	struct turtile_output *output;
+
+	json_writer_begin_object(response);
+	json_writer_key(response, "generation");
+	json_writer_int(response, server->generation);
+
+	// Workspaces are not tied to an output yet, every output shows the
+	// active workspace
+	json_writer_key(response, "outputs");
+	json_writer_begin_array(response);
+	wl_list_for_each(output, &server->outputs, link) {
+		struct wlr_box box;
+		wlr_output_layout_get_box(server->output_layout, output->wlr_output,
+								  &box);
+		json_writer_begin_object(response);
+		json_writer_key(response, "name");
+		json_writer_string(response, output->wlr_output->name);
+		json_writer_key(response, "x");
+		json_writer_int(response, box.x);
+		json_writer_key(response, "y");
+		json_writer_int(response, box.y);
+		json_writer_key(response, "width");
+		json_writer_int(response, box.width);
+		json_writer_key(response, "height");
+		json_writer_int(response, box.height);
+		json_writer_key(response, "workspace");
+		json_writer_string(response, server->active_workspace ?
+						   server->active_workspace->name : NULL);
+		json_writer_end_object(response);
+	}
+	json_writer_end_array(response);
+
+	json_writer_key(response, "workspaces");
+	json_writer_begin_array(response);
+	wl_list_for_each(workspace, &server->workspaces, link) {
+		json_writer_begin_object(response);
+		json_writer_key(response, "name");
+		json_writer_string(response, workspace->name);
+		json_writer_key(response, "active");
+		json_writer_bool(response, workspace == server->active_workspace);
+
+		// In layout order, the first window of a workspace is its master
+		bool master = true;
+		json_writer_key(response, "windows");
+		json_writer_begin_array(response);
+		wl_list_for_each(toplevel, &server->toplevels, link) {
+			if (toplevel->workspace != workspace || !toplevel->xdg_toplevel)
+				continue;
+			json_writer_begin_object(response);
+			write_window_members(response, toplevel, WINDOW_FIELD_ID |
+								 WINDOW_FIELD_APP | WINDOW_FIELD_TITLE |
+								 WINDOW_FIELD_GEOMETRY);
+			json_writer_key(response, "master");
+			json_writer_bool(response, master);
+			json_writer_key(response, "focused");
+			json_writer_bool(response, toplevel == focused);
+			json_writer_end_object(response);
+			master = false;
+		}
+		json_writer_end_array(response);
+		json_writer_end_object(response);
+	}
+	json_writer_end_array(response);
+
+	// Window ids, most recently focused first
+	json_writer_key(response, "focus_order");
+	json_writer_begin_array(response);
+	wl_list_for_each(toplevel, &server->focus_toplevels, flink) {
+		json_writer_string(response, toplevel->id);
+	}
+	json_writer_end_array(response);
+	json_writer_end_object(response);
+}
+
+/**
+ * A change requested by apply: moving |toplevel| to |workspace|, or making it
+ * the master of |workspace|.
+ */
+struct apply_change {
+	struct turtile_toplevel *toplevel;
+	struct turtile_workspace *workspace;
+	bool master;
+};
+
+/**
+ * The desired state given to apply, checked completely before anything is
+ * changed.
+ */
+struct apply_plan {
+	struct apply_change *changes;
+	size_t len;
+	size_t cap;
+	struct turtile_workspace *active;
+};
+
+static bool apply_plan_add(struct apply_plan *plan,
+						   struct turtile_toplevel *toplevel,
+						   struct turtile_workspace *workspace, bool master,
+						   struct json_writer *response) {
+	for (size_t i = 0; i < plan->len; i++) {
+		if (plan->changes[i].master != master)
+			continue;
+		if (master && plan->changes[i].workspace == workspace) {
+			reply_error(response, "workspace %s has two masters",
+						workspace->name);
+			return false;
+		}
+		if (!master && plan->changes[i].toplevel == toplevel) {
+			reply_error(response, "window %s is listed twice", toplevel->id);
+			return false;
+		}
+	}
+
+	if (plan->len == plan->cap) {
+		size_t cap = plan->cap ? plan->cap * 2 : 16;
+		struct apply_change *changes =
+			realloc(plan->changes, cap * sizeof(*changes));
+		if (!changes) {
+			reply_error(response, "out of memory");
+			return false;
+		}
+		plan->changes = changes;
+		plan->cap = cap;
+	}
+	plan->changes[plan->len++] = (struct apply_change){
+		.toplevel = toplevel, .workspace = workspace, .master = master };
+	return true;
+}
+
+static struct turtile_toplevel *apply_read_window(struct json_reader *reader,
+												  struct turtile_server *server,
+												  struct json_writer *response) {
+	char *id;
+	if (!json_reader_string(reader, &id))
+		return NULL;
+
+	struct turtile_toplevel *toplevel = get_toplevel(server, id);
+	if (!toplevel)
+		reply_error(response, "window %s not found", id);
+	return toplevel;
+}
+
+/**
+ * Reads the desired state of one workspace: {"windows": [ids], "master": id}
+ */
+static bool apply_read_workspace(struct json_reader *reader,
+								 struct turtile_server *server,
+								 struct turtile_workspace *workspace,
+								 struct apply_plan *plan,
+								 struct json_writer *response) {
+	struct turtile_toplevel *toplevel;
+	char *key;
+
+	if (!json_reader_begin_object(reader))
+		return false;
+	while (json_reader_next_member(reader, &key)) {
+		if (strcmp(key, "windows") == 0) {
+			if (!json_reader_begin_array(reader))
+				return false;
+			while (json_reader_next_element(reader)) {
+				if (!(toplevel = apply_read_window(reader, server, response)) ||
+					!apply_plan_add(plan, toplevel, workspace, false, response))
+					return false;
+			}
+		} else if (strcmp(key, "master") == 0) {
+			if (!(toplevel = apply_read_window(reader, server, response)) ||
+				!apply_plan_add(plan, toplevel, workspace, true, response))
+				return false;
+		} else {
+			reply_error(response, "unknown key %s", key);
+			return false;
+		}
+	}
+	return !reader->error;
+}
+
+/**
+ * Reads the whole desired state into |plan|, replying with an error if it is
+ * malformed or names windows or workspaces that don't exist.
+ */
+static bool apply_read_plan(char *json, struct turtile_server *server,
+							struct apply_plan *plan,
+							struct json_writer *response) {
+	struct json_reader reader;
+	struct turtile_workspace *workspace;
+	char *key, *name;
+
+	json_reader_init(&reader, json);
+	if (!json_reader_begin_object(&reader))
+		goto invalid;
+	while (json_reader_next_member(&reader, &key)) {
+		if (strcmp(key, "workspaces") == 0) {
+			if (!json_reader_begin_object(&reader))
+				goto invalid;
+			while (json_reader_next_member(&reader, &name)) {
+				if (!(workspace = get_workspace(server, name))) {
+					reply_error(response, "workspace %s not found", name);
+					return false;
+				}
+				if (!apply_read_workspace(&reader, server, workspace, plan,
+										  response))
+					goto invalid;
+			}
+		} else if (strcmp(key, "active") == 0) {
+			if (!json_reader_string(&reader, &name))
+				goto invalid;
+			if (!(plan->active = get_workspace(server, name))) {
+				reply_error(response, "workspace %s not found", name);
+				return false;
+			}
+		} else {
+			reply_error(response, "unknown key %s", key);
+			return false;
+		}
+	}
+	if (json_reader_end(&reader))
+		return true;
+
+invalid:
+	// Errors about the contents have been replied already
+	if (reader.error)
+		reply_error(response, "invalid JSON at offset %td: %s",
+					reader.pos - json, reader.error);
+	return false;
+}
+
+static struct turtile_toplevel *workspace_master(struct turtile_server *server,
+												 struct turtile_workspace *workspace) {
+	struct turtile_toplevel *toplevel;
+	wl_list_for_each(toplevel, &server->toplevels, link) {
+		if (toplevel->workspace == workspace)
+			return toplevel;
 	}
+	return NULL;
+}
+
+void apply_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context) {
+	// Bring the layout to the desired state given as JSON, only changing what
+	// differs, all in one transaction so it is relaid out once. The document
+	// may take up to MAX_MSG_SIZE bytes, a few thousand window ids.
+	struct turtile_server *server = context->server;
+	struct apply_plan plan = {0};
+	int nchanges = 0;
+
+	if (ntokens == 0) {
+		reply_error(response, "missing argument: state");
+		return;
+	}
+	if (!apply_read_plan(tokens[0], server, &plan, response))
+		goto out;
+
+	// A master has to end up on the workspace it is master of
+	for (size_t i = 0; i < plan.len; i++) {
+		struct apply_change *master = &plan.changes[i];
+		if (!master->master)
+			continue;
+
+		struct turtile_workspace *workspace = master->toplevel->workspace;
+		for (size_t j = 0; j < plan.len; j++) {
+			if (plan.changes[j].toplevel == master->toplevel &&
+				!plan.changes[j].master)
+				workspace = plan.changes[j].workspace;
+		}
+		if (workspace != master->workspace) {
+			reply_error(response, "window %s is not on workspace %s",
+						master->toplevel->id, master->workspace->name);
+			goto out;
+		}
+	}
+
+	server_begin_transaction(server);
+	for (size_t i = 0; i < plan.len; i++) {
+		struct apply_change *change = &plan.changes[i];
+		if (change->master || change->toplevel->workspace == change->workspace)
+			continue;
+		schedule_workspace_cleanup(change->toplevel->workspace);
+		change->toplevel->workspace = change->workspace;
+		change->toplevel->generation = server_bump_generation(server);
+		server_redraw_windows(server);
+		emit_window_event(server, "move", change->toplevel);
+		nchanges++;
+	}
+	for (size_t i = 0; i < plan.len; i++) {
+		struct apply_change *change = &plan.changes[i];
+		if (!change->master ||
+			workspace_master(server, change->workspace) == change->toplevel)
+			continue;
+		set_master_toplevel(change->toplevel);
+		nchanges++;
+	}
+	if (plan.active && plan.active != server->active_workspace) {
+		switch_workspace(plan.active);
+		nchanges++;
+	}
+	server_commit_transaction(server);
+
+	reply_success(response, "applied %d changes", nchanges);
+out:
+	free(plan.changes);
+}
+
+void process_list_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context) {
+    struct turtile_server *server = context->server;
+
+    if (ntokens > 0) {
+        reply_error(response, "invalid argument %s", tokens[0]);
+        return;
+    }
+    if (!server || !server->spawner) {
+        reply_error(response, "No processes found");
+        return;
+    }
+
+    json_writer_begin_array(response);
+
+    struct turtile_process *process;
+    wl_list_for_each(process, &server->spawner->processes, link) {
+        json_writer_begin_object(response);
+        json_writer_key(response, "pid");
+        json_writer_int(response, process->pid);
+        json_writer_key(response, "command");
+        json_writer_string(response, process->cmd);
+        json_writer_key(response, "started");
+        json_writer_int(response, process->started);
+        json_writer_end_object(response);
+    }
+
+    json_writer_end_array(response);
+}
+
+void config_reload_command(char *tokens[], int ntokens,
+		struct json_writer *response, struct turtile_context *context) {
+    char error[256];
+
+    if (ntokens > 0) {
+        reply_error(response, "invalid argument %s", tokens[0]);
+        return;
+    }
+    if (!config_reload(context->server, error, sizeof(error))) {
+        reply_error(response, "%s", error);
+        return;
+    }
+    reply_success(response, "config reloaded");
 }
@@ -22,24 +22,138 @@
 
 #ifndef COMMANDS_H
 #define COMMANDS_H
+#include "json_writer.h"
 #include "src/server.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_MSG_ELEMENTS 32 // max number of tokens in a command
+
+struct turtile_socket_client;
 
 struct turtile_context{
 	struct turtile_server *server;
+	struct turtile_socket_client *client; // NULL if not run from the socket
 };
 
+/**
+ * Function implementing a command.
+ *
+ * @param tokens   The arguments of the command, without the command and
+ *                 subcommand names.
+ * @param ntokens  The number of arguments.
+ * @param response The writer the JSON response is streamed to.
+ * @param context  A pointer to the turtile context structure.
+ */
+typedef void (*command_func_t)(char *tokens[], int ntokens,
+							   struct json_writer *response,
+							   struct turtile_context *context);
+
+enum command_flags {
+	// The command gets the rest of the message unsplit, as its only argument
+	COMMAND_RAW_ARGS = 1 << 0,
+};
+
+/**
+ * Register the built-in commands. Must be called once at startup, before any
+ * command is executed.
+ */
+void commands_init(void);
+
+/**
+ * Register a command, making it available to execute_command().
+ *
+ * Modules register their commands at startup. A command registered without a
+ * subcommand name also handles every subcommand that is not registered on
+ * its own, like help messages.
+ *
+ * @param cmd_name    The name of the command, must outlive the registration.
+ * @param subcmd_name The name of the subcommand, or NULL.
+ * @param func        The function implementing the command.
+ * @param flags       A bitmask of command_flags.
+ * @return false if the command is already registered or out of memory.
+ */
+bool commands_register(const char *cmd_name, const char *subcmd_name,
+					   command_func_t func, uint32_t flags);
+
+/**
+ * Unregister every command and free the command table.
+ */
+void commands_finish(void);
+
 /**
  * Execute a command with the given message and context.
  *
  * This function takes a message string, splits it into tokens, and executes the
  * corresponding command based on the tokens. If the command is not recognized,
- * it returns an error message.
+ * it returns an error message. It is reentrant, so commands may execute other
+ * commands.
  *
  * @param message  The message string to execute as a command.
- * @param response A buffer to store the response to the command.
+ * @param response The writer the JSON response to the command is streamed to.
  * @param context  A pointer to the turtile context structure.
  */
-void execute_command(char *message, char *response,
+void execute_command(char *message, struct json_writer *response,
 					 struct turtile_context *context);
 
+/**
+ * Execute a command on behalf of the compositor itself, for keybinds and
+ * config entries, without going through the socket. The reply is dropped,
+ * errors are logged.
+ *
+ * @param server  The server.
+ * @param command The command and its arguments.
+ */
+void execute_internal_command(struct turtile_server *server,
+							  const char *command);
+
+// Fields of the window object, used to project window list replies
+enum window_fields {
+	WINDOW_FIELD_ID = 1 << 0,
+	WINDOW_FIELD_APP = 1 << 1,
+	WINDOW_FIELD_TITLE = 1 << 2,
+	WINDOW_FIELD_WORKSPACE = 1 << 3,
+	WINDOW_FIELD_GEOMETRY = 1 << 4, // x, y, width and height
+	// fields of window list replies and window events by default
+	WINDOW_FIELDS_DEFAULT = (1 << 4) - 1,
+};
+
+/**
+ * Write the JSON object describing a window, as used by window list and the
+ * window events. The serialized object is kept on the toplevel and reused
+ * until the window changes.
+ *
+ * @param writer   The writer the object is streamed to.
+ * @param toplevel The window to describe.
+ */
+void write_window(struct json_writer *writer, struct turtile_toplevel *toplevel);
+
+/**
+ * Write the JSON object describing a window with only some of its fields.
+ *
+ * @param writer   The writer the object is streamed to.
+ * @param toplevel The window to describe.
+ * @param fields   Bitmask of enum window_fields to include.
+ */
+void write_window_fields(struct json_writer *writer,
+						 struct turtile_toplevel *toplevel, uint32_t fields);
+
+/**
+ * Write a {"success": "..."} response.
+ *
+ * @param response The writer the response goes to.
+ * @param format   A printf style format of the message.
+ */
+void reply_success(struct json_writer *response, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/**
+ * Write an {"error": "..."} response.
+ *
+ * @param response The writer the response goes to.
+ * @param format   A printf style format of the message.
+ */
+void reply_error(struct json_writer *response, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
 #endif // COMMANDS_H
@@ -25,6 +25,8 @@
 #include "src/workspace.h"
 #include "wlr/util/log.h"
 #include "wlr/types/wlr_keyboard.h"
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,126 +37,275 @@
 // Global configuration instance
 static turtile_config_t *config_instance = NULL;
 
+static turtile_config_t *config_create(void);
+
 // Array of configuration parameters
 config_param_t config_params[] = {
     {"keybinds", load_keybinds},
+    {"modes", load_modes},
     {"autostart", load_autostart},
     {"workspaces", load_workspaces},
     {"background_color", load_background_color},
+    {"keyboard", load_keyboard},
+    {"reload_on_change", load_reload_on_change},
     // Add more configuration parameters here
 };
 
-// Helper function to create a new keybind
-static turtile_keybind_t *keybind_create(uint32_t mods, xkb_keysym_t key, const char *cmd) {
-    turtile_keybind_t *keybind = malloc(sizeof(turtile_keybind_t));
-    if (!keybind) {
-		wlr_log(WLR_ERROR, "Failed to allocate keybind");
-        return NULL;
+/**
+ * FNV-1a hash of the modifiers and key of a keybind.
+ */
+static size_t keybind_hash(uint32_t mods, xkb_keysym_t key) {
+    uint32_t hash = 2166136261u;
+    uint32_t words[2] = {mods, key};
+
+    for (int i = 0; i < 2; i++) {
+        for (int shift = 0; shift < 32; shift += 8)
+            hash = (hash ^ ((words[i] >> shift) & 0xff)) * 16777619u;
     }
-    keybind->mods = mods;
-    keybind->key = key;
-    keybind->cmd = strdup(cmd);
-    if (!keybind->cmd) {
-        free(keybind);
-        return NULL;
+    return hash;
+}
+
+/**
+ * Finds the slot of a keybind in the table, or the empty slot where it would
+ * be inserted.
+ */
+static turtile_keybind_t **keybind_slot(turtile_keybind_t **table, size_t size,
+                                        uint32_t mods, xkb_keysym_t key) {
+    size_t mask = size - 1;
+    size_t i = keybind_hash(mods, key) & mask;
+
+    while (table[i] != NULL &&
+           (table[i]->mods != mods || table[i]->key != key))
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+turtile_keybind_map_t *config_find_mode(turtile_config_t *config,
+                                        const char *name) {
+    if (strcmp(name, KEYBIND_DEFAULT_MODE) == 0)
+        return &config->keybinds;
+
+    for (size_t i = 0; i < config->mode_count; i++) {
+        if (strcmp(config->modes[i].name, name) == 0)
+            return &config->modes[i].keybinds;
     }
-    wl_list_init(&keybind->link);
-    return keybind;
+    return NULL;
 }
 
-void load_keybinds(config_t *cfg, const char *value) {
-    config_setting_t *keybinds_setting = config_lookup(cfg, "keybinds");
-    if (!keybinds_setting) {
-        wlr_log(WLR_ERROR, "Keybinds not found in configuration");
+/**
+ * Builds the keybind table and the set of bound modifiers of a map and of
+ * the chords it starts, and resolves the modes its keybinds enter. The last
+ * keybind of the file wins when several bind the same keys.
+ */
+static void index_keybind_map(turtile_config_t *config,
+                              turtile_keybind_map_t *map) {
+    size_t size = 16;
+    while (size < map->keybind_count * 2)
+        size *= 2;
+
+    memset(map->mods, 0, sizeof(map->mods));
+    map->table = arena_array(&config->arena, size, sizeof(*map->table));
+    map->table_size = map->table ? size : 0;
+    if (!map->table) {
+        wlr_log(WLR_ERROR, "Failed to allocate the keybind table");
         return;
     }
 
-    int count = config_setting_length(keybinds_setting);
-    for (int i = 0; i < count; i++) {
-        config_setting_t *keybind_setting = config_setting_get_elem(keybinds_setting, i);
-        if (!keybind_setting) {
-            continue;
-        }
+    for (size_t i = map->keybind_count; i-- > 0;) {
+        turtile_keybind_t *keybind = &map->keybinds[i];
+        turtile_keybind_t **slot =
+            keybind_slot(map->table, size, keybind->mods, keybind->key);
+        if (*slot == NULL)
+            *slot = keybind;
+        if (keybind->mods < KEYBIND_MODS_MAX)
+            map->mods[keybind->mods / 64] |= UINT64_C(1) << (keybind->mods % 64);
+
+        if (keybind->then)
+            index_keybind_map(config, keybind->then);
+        if (keybind->mode_name &&
+            !(keybind->mode = config_find_mode(config, keybind->mode_name)))
+            wlr_log(WLR_ERROR, "Keybind enters unknown mode '%s'",
+                    keybind->mode_name);
+    }
+}
+
+static void index_keybinds(turtile_config_t *config) {
+    index_keybind_map(config, &config->keybinds);
+
+    for (size_t i = 0; i < config->mode_count; i++)
+        index_keybind_map(config, &config->modes[i].keybinds);
+}
+
+static void load_keybind_list(turtile_config_t *config,
+                              config_setting_t *keybinds_setting,
+                              turtile_keybind_map_t *map, int depth);
+
+/**
+ * Reads a keybind of the config.
+ *
+ * @param keybind Filled with the keybind.
+ * @param depth The number of keys of the chord before this one.
+ * @return false if the keybind is invalid.
+ */
+static bool load_keybind(turtile_config_t *config,
+                         config_setting_t *keybind_setting,
+                         turtile_keybind_t *keybind, int depth) {
+    // Fetch and parse modifiers
+    config_setting_t *mod_setting = config_setting_lookup(keybind_setting, "mod");
+    uint32_t mods = 0;
+    if (mod_setting) {
+        for (int j = 0; j < config_setting_length(mod_setting); j++) {
+            const char *mod_str = config_setting_get_string_elem(mod_setting, j);
+            if (!mod_str) {
+                wlr_log(WLR_ERROR, "Invalid modifier string in configuration");
+                continue;
+            }
 
-		// Fetch and parse modifiers
-        config_setting_t *mod_setting = config_setting_lookup(keybind_setting, "mod");
-        uint32_t mods = 0;
-        if (mod_setting) {
-            for (int j = 0; j < config_setting_length(mod_setting); j++) {
-                const char *mod_str = config_setting_get_string_elem(mod_setting, j);
-                if (!mod_str) {
-                    wlr_log(WLR_ERROR, "Invalid modifier string in configuration");
-                    continue;
-                }
-
-                // Parse modifier strings into bitmask
-                if (strstr(mod_str, "shift")) {
-                    mods |= WLR_MODIFIER_SHIFT;
-                } else if (strstr(mod_str, "ctrl")) {
-                    mods |= WLR_MODIFIER_CTRL;
-                } else if (strstr(mod_str, "alt")) {
-                    mods |= WLR_MODIFIER_ALT;
-                } else if (strstr(mod_str, "mod4")) {
-                    mods |= WLR_MODIFIER_LOGO;
-                } else if (strstr(mod_str, "super")) {
-                    mods |= WLR_MODIFIER_LOGO;
-                } else if (strstr(mod_str, "mod2")) {
-                    mods |= WLR_MODIFIER_MOD2;
-                } else {
-                    wlr_log(WLR_ERROR, "Unknown modifier '%s' in configuration", mod_str);
-                }
+            // Parse modifier strings into bitmask
+            if (strstr(mod_str, "shift")) {
+                mods |= WLR_MODIFIER_SHIFT;
+            } else if (strstr(mod_str, "ctrl")) {
+                mods |= WLR_MODIFIER_CTRL;
+            } else if (strstr(mod_str, "alt")) {
+                mods |= WLR_MODIFIER_ALT;
+            } else if (strstr(mod_str, "mod4")) {
+                mods |= WLR_MODIFIER_LOGO;
+            } else if (strstr(mod_str, "super")) {
+                mods |= WLR_MODIFIER_LOGO;
+            } else if (strstr(mod_str, "mod2")) {
+                mods |= WLR_MODIFIER_MOD2;
+            } else {
+                wlr_log(WLR_ERROR, "Unknown modifier '%s' in configuration", mod_str);
             }
         }
+    }
 
-        const char *key_str;
-        if (!config_setting_lookup_string(keybind_setting, "key", &key_str)) {
-            wlr_log(WLR_ERROR, "Keybind missing command in configuration");
-            continue;
+    const char *key_str;
+    if (!config_setting_lookup_string(keybind_setting, "key", &key_str)) {
+        wlr_log(WLR_ERROR, "Keybind missing key in configuration");
+        return false;
+    }
+    if (!key_str) {
+        wlr_log(WLR_ERROR, "Keybind has an invalid key string");
+        return false;
+    }
+
+    // Convert key string to keysym
+    xkb_keysym_t key = xkb_keysym_from_name(key_str, XKB_KEYSYM_NO_FLAGS);
+    if (key == XKB_KEY_NoSymbol) {
+        wlr_log(WLR_ERROR, "Invalid key name '%s' in configuration", key_str);
+        return false;
+    }
+
+    *keybind = (turtile_keybind_t){.mods = mods, .key = key};
+
+    // A chord continues with the keys of "then", other keybinds run a
+    // command, enter a mode, or both
+    config_setting_t *then_setting =
+        config_setting_lookup(keybind_setting, "then");
+    const char *cmd = NULL, *mode = NULL;
+    if (then_setting) {
+        if (depth + 1 >= KEYBIND_CHORD_MAX) {
+            wlr_log(WLR_ERROR, "Chord of key '%s' is longer than %d keys",
+                    key_str, KEYBIND_CHORD_MAX);
+            return false;
         }
-		if (!key_str) {
-			wlr_log(WLR_ERROR, "Keybind has an invalid key string");
-			continue;
-		}
-		
-		// Convert key string to keysym
-		xkb_keysym_t key = xkb_keysym_from_name(key_str, XKB_KEYSYM_NO_FLAGS);
-		if (key == XKB_KEY_NoSymbol) {
-			wlr_log(WLR_ERROR, "Invalid key name '%s' in configuration", key_str);
-			continue;
-		}
-
-        const char *cmd;
-        if (!config_setting_lookup_string(keybind_setting, "cmd", &cmd)) {
-            wlr_log(WLR_ERROR, "Keybind missing command in configuration");
-            continue;
+        keybind->then = arena_alloc(&config->arena, sizeof(*keybind->then));
+        if (!keybind->then) {
+            wlr_log(WLR_ERROR, "Failed to allocate keybind");
+            return false;
         }
+        load_keybind_list(config, then_setting, keybind->then, depth + 1);
+        return true;
+    }
 
-        turtile_keybind_t *keybind = keybind_create(mods, key, cmd);
-        if (keybind) {
-            wl_list_insert(&config_get_instance()->keybinds, &keybind->link);
-        } else {
-            wlr_log(WLR_ERROR, "Failed to create keybind");
+    if (config_setting_lookup_string(keybind_setting, "command", &cmd))
+        keybind->internal = true;
+    else
+        config_setting_lookup_string(keybind_setting, "cmd", &cmd);
+    config_setting_lookup_string(keybind_setting, "mode", &mode);
+    if (!cmd && !mode) {
+        wlr_log(WLR_ERROR, "Keybind missing command in configuration");
+        return false;
+    }
+    keybind->cmd = arena_intern(&config->arena, cmd);
+    keybind->mode_name = arena_intern(&config->arena, mode);
+    if ((cmd && !keybind->cmd) || (mode && !keybind->mode_name)) {
+        wlr_log(WLR_ERROR, "Failed to create keybind");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads a list of keybinds of the config into an array of the map, leaving
+ * out the invalid ones.
+ */
+static void load_keybind_list(turtile_config_t *config,
+                              config_setting_t *keybinds_setting,
+                              turtile_keybind_map_t *map, int depth) {
+    int count = config_setting_length(keybinds_setting);
+    map->keybinds = arena_array(&config->arena, count, sizeof(*map->keybinds));
+    map->keybind_count = 0;
+    if (!map->keybinds) {
+        wlr_log(WLR_ERROR, "Failed to allocate keybinds");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        config_setting_t *keybind_setting = config_setting_get_elem(keybinds_setting, i);
+        if (!keybind_setting) {
+            continue;
         }
+
+        if (load_keybind(config, keybind_setting,
+                         &map->keybinds[map->keybind_count], depth))
+            map->keybind_count++;
     }
 }
 
-// Helper function to create a new autostart
-static turtile_autostart_t *autostart_create(const char *cmd) {
-    turtile_autostart_t *autostart = malloc(sizeof(turtile_autostart_t));
-    if (!autostart) {
-		wlr_log(WLR_ERROR, "Failed to allocate autostart");
-        return NULL;
+void load_keybinds(turtile_config_t *config, config_t *cfg, const char *value) {
+    config_setting_t *keybinds_setting = config_lookup(cfg, "keybinds");
+    if (!keybinds_setting) {
+        wlr_log(WLR_ERROR, "Keybinds not found in configuration");
+        return;
     }
-    autostart->cmd = strdup(cmd);
-    if (!autostart->cmd) {
-        free(autostart);
-        return NULL;
+    load_keybind_list(config, keybinds_setting, &config->keybinds, 0);
+}
+
+void load_modes(turtile_config_t *config, config_t *cfg, const char *value) {
+    config_setting_t *modes_setting = config_lookup(cfg, "modes");
+    if (!modes_setting || !config_setting_is_group(modes_setting)) {
+        wlr_log(WLR_ERROR, "modes must be a group of keybind lists");
+        return;
+    }
+
+    int count = config_setting_length(modes_setting);
+    config->modes = arena_array(&config->arena, count, sizeof(*config->modes));
+    if (!config->modes) {
+        wlr_log(WLR_ERROR, "Failed to allocate modes");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        config_setting_t *mode_setting = config_setting_get_elem(modes_setting, i);
+        const char *name = config_setting_name(mode_setting);
+        if (!name || strcmp(name, KEYBIND_DEFAULT_MODE) == 0) {
+            wlr_log(WLR_ERROR, "Invalid mode name in configuration");
+            continue;
+        }
+
+        turtile_mode_config_t *mode = &config->modes[config->mode_count];
+        if (!(mode->name = arena_intern(&config->arena, name))) {
+            wlr_log(WLR_ERROR, "Failed to allocate mode");
+            continue;
+        }
+        load_keybind_list(config, mode_setting, &mode->keybinds, 0);
+        config->mode_count++;
     }
-    wl_list_init(&autostart->link);
-    return autostart;
 }
 
-void load_autostart(config_t *cfg, const char *value) {
+void load_autostart(turtile_config_t *config, config_t *cfg, const char *value) {
     config_setting_t *autostart_setting = config_lookup(cfg, "autostart");
     if (!autostart_setting) {
         wlr_log(WLR_ERROR, "Autostart not found in configuration");
@@ -162,40 +313,46 @@ void load_autostart(config_t *cfg, const char *value) {
     }
 
     int count = config_setting_length(autostart_setting);
+    config->autostart =
+        arena_array(&config->arena, count, sizeof(*config->autostart));
+    if (!config->autostart) {
+        wlr_log(WLR_ERROR, "Failed to allocate autostart");
+        return;
+    }
+
     for (int i = 0; i < count; i++) {
-        const char *cmd = config_setting_get_string_elem(autostart_setting, i);
+        // A shell command, or a group holding a shell command (cmd) and the
+        // workspace to open it on, or a turtile command (command)
+        config_setting_t *entry = config_setting_get_elem(autostart_setting, i);
+        const char *cmd = config_setting_get_string(entry);
+        const char *workspace = NULL;
+        bool internal = false;
+        if (!cmd && config_setting_is_group(entry)) {
+            if (config_setting_lookup_string(entry, "command", &cmd))
+                internal = true;
+            else
+                config_setting_lookup_string(entry, "cmd", &cmd);
+            config_setting_lookup_string(entry, "workspace", &workspace);
+        }
         if (!cmd) {
             wlr_log(WLR_ERROR, "Autostart command missing or invalid");
             continue;
         }
 
-        turtile_autostart_t *autostart = autostart_create(cmd);
-        if (autostart) {
-            wl_list_insert(&config_get_instance()->autostart, &autostart->link);
+        turtile_autostart_t *autostart =
+            &config->autostart[config->autostart_count];
+        autostart->cmd = arena_intern(&config->arena, cmd);
+        autostart->internal = internal;
+        autostart->workspace = arena_intern(&config->arena, workspace);
+        if (autostart->cmd && (!workspace || autostart->workspace)) {
+            config->autostart_count++;
         } else {
             wlr_log(WLR_ERROR, "Failed to create autostart command");
         }
     }
 }
 
-// Helper function to create a new workspace
-static turtile_workspace_config_t *workspace_config_create(const char *name) {
-    turtile_workspace_config_t *workspace =
-		malloc(sizeof(turtile_workspace_config_t));
-    if (!workspace) {
-		wlr_log(WLR_ERROR, "Failed to allocate workspace");
-        return NULL;
-    }
-    workspace->name = strdup(name);
-    if (!workspace->name) {
-        free(workspace);
-        return NULL;
-    }
-    wl_list_init(&workspace->link);
-    return workspace;
-}
-
-void load_workspaces(config_t *cfg, const char *value) {
+void load_workspaces(turtile_config_t *config, config_t *cfg, const char *value) {
     config_setting_t *workspaces_setting = config_lookup(cfg, "workspaces");
     if (!workspaces_setting) {
         wlr_log(WLR_ERROR, "Workspaces not found in configuration");
@@ -203,6 +360,13 @@ void load_workspaces(config_t *cfg, const char *value) {
     }
 
     int count = config_setting_length(workspaces_setting);
+    config->workspaces =
+        arena_array(&config->arena, count, sizeof(*config->workspaces));
+    if (!config->workspaces) {
+        wlr_log(WLR_ERROR, "Failed to allocate workspaces");
+        return;
+    }
+
     for (int i = 0; i < count; i++) {
         const char *name = config_setting_get_string_elem(workspaces_setting, i);
         if (!name || strlen(name) > 100) {
@@ -210,46 +374,90 @@ void load_workspaces(config_t *cfg, const char *value) {
             continue;
         }
 
-        turtile_workspace_config_t *workspace = workspace_config_create(name);
-        if (workspace) {
-            wl_list_insert(&config_get_instance()->workspaces, &workspace->link);
+        turtile_workspace_config_t *workspace =
+            &config->workspaces[config->workspace_count];
+        if ((workspace->name = arena_intern(&config->arena, name))) {
+            config->workspace_count++;
         } else {
             wlr_log(WLR_ERROR, "Failed to create workspace config");
         }
     }
 }
 
-void load_background_color(config_t *cfg, const char *value) {
-	float *backgroundColor = malloc(sizeof(float[4]));
-    if (!backgroundColor) {
-		wlr_log(WLR_ERROR, "Failed to allocate backgroundColor");
-        return;
-    }
+void load_background_color(turtile_config_t *config, config_t *cfg, const char *value) {
     config_setting_t *background_setting = config_lookup(cfg, "background_color");
     if (!background_setting) {
         wlr_log(WLR_ERROR, "background_color not found in configuration");
 		return;
     }
+	float *backgroundColor = config->backgroundColor;
 	for (int i = 0; i < 3; i++) {
 		backgroundColor[i]  = config_setting_get_float_elem(background_setting, i);
 	}
 	backgroundColor[3] = 1.0;
-	config_get_instance()->backgroundColor = backgroundColor;
 }
 
-void config_load_from_file(const char *filepath) {
-    char full_path[256];
-    realpath(filepath, full_path);
-    wlr_log(WLR_INFO, "Attempting to load config from: %s\n", full_path);
+/**
+ * Replaces a keymap name of the keyboard config with the one of the config
+ * file, if any.
+ */
+static void load_keyboard_name(turtile_config_t *config,
+                               config_setting_t *setting, const char *name,
+                               const char **value) {
+    const char *string;
+    if (!config_setting_lookup_string(setting, name, &string))
+        return;
+    *value = arena_intern(&config->arena, string);
+}
+
+void load_keyboard(turtile_config_t *config, config_t *cfg, const char *value) {
+    config_setting_t *keyboard_setting = config_lookup(cfg, "keyboard");
+    if (!keyboard_setting || !config_setting_is_group(keyboard_setting)) {
+        wlr_log(WLR_ERROR, "keyboard must be a group");
+        return;
+    }
+    turtile_keyboard_config_t *keyboard = &config->keyboard;
+
+    load_keyboard_name(config, keyboard_setting, "rules", &keyboard->rules);
+    load_keyboard_name(config, keyboard_setting, "model", &keyboard->model);
+    load_keyboard_name(config, keyboard_setting, "layout", &keyboard->layout);
+    load_keyboard_name(config, keyboard_setting, "variant", &keyboard->variant);
+    load_keyboard_name(config, keyboard_setting, "options", &keyboard->options);
+    config_setting_lookup_int(keyboard_setting, "repeat_rate",
+                              &keyboard->repeat_rate);
+    config_setting_lookup_int(keyboard_setting, "repeat_delay",
+                              &keyboard->repeat_delay);
+}
+
+void load_reload_on_change(turtile_config_t *config, config_t *cfg,
+                           const char *value) {
+    int reload_on_change;
+    if (config_lookup_bool(cfg, "reload_on_change", &reload_on_change))
+        config->reload_on_change = reload_on_change;
+}
+
+turtile_config_t *config_parse(const char *filepath, char *error, size_t size) {
+    char full_path[PATH_MAX];
+    if (!realpath(filepath, full_path)) {
+        snprintf(error, size, "%s: %s", filepath, strerror(errno));
+        return NULL;
+    }
 
     config_t cfg;
     config_init(&cfg);
-    if (!config_read_file(&cfg, filepath)) {
-        wlr_log(WLR_ERROR, "Error reading configuration file: %s", filepath);
-		wlr_log(WLR_ERROR, "Error on line %d: %s\n", config_error_line(&cfg),
-				config_error_text(&cfg));
+    if (!config_read_file(&cfg, full_path)) {
+        snprintf(error, size, "%s:%d: %s", filepath, config_error_line(&cfg),
+                 config_error_text(&cfg));
         config_destroy(&cfg);
-        return;
+        return NULL;
+    }
+
+    turtile_config_t *config = config_create();
+    if (!config || !(config->path = arena_intern(&config->arena, full_path))) {
+        snprintf(error, size, "failed to allocate the config");
+        config_release(config);
+        config_destroy(&cfg);
+        return NULL;
     }
 
     // Iterate over the configuration parameters and load each one
@@ -257,54 +465,76 @@ void config_load_from_file(const char *filepath) {
         config_param_t *param = &config_params[i];
         config_setting_t *setting = config_lookup(&cfg, param->name);
         if (setting) {
-            param->load(&cfg, config_setting_get_string(setting));
+            param->load(config, &cfg, config_setting_get_string(setting));
         }
     }
 
+    index_keybinds(config);
     config_destroy(&cfg);
+    return config;
 }
 
-turtile_config_t *config_get_instance(void) {
-    if (!config_instance) {
-        config_instance = malloc(sizeof(turtile_config_t));
-        if (!config_instance) {
-            return NULL;
-        }
-        wl_list_init(&config_instance->keybinds);
-        wl_list_init(&config_instance->autostart);
-        wl_list_init(&config_instance->workspaces);
-        config_instance->backgroundColor = malloc(sizeof(float[4]));
+void config_load_from_file(const char *filepath) {
+    wlr_log(WLR_INFO, "Attempting to load config from: %s", filepath);
+
+    char error[256];
+    turtile_config_t *config = config_parse(filepath, error, sizeof(error));
+    if (!config) {
+        wlr_log(WLR_ERROR, "Error reading configuration file %s", error);
+        return;
     }
-    return config_instance;
+    config_release(config_swap_instance(config));
 }
 
-void config_free_instance(void) {
-    if (config_instance) {
-        // Free keybinds
-        turtile_keybind_t *keybind, *tmp;
-        wl_list_for_each_safe(keybind, tmp, &config_instance->keybinds, link) {
-            free(keybind->cmd);
-            free(keybind);
-        }
-
-        // Free autostart
-        turtile_autostart_t *autostart, *tmp2;
-        wl_list_for_each_safe(autostart, tmp2, &config_instance->autostart, link) {
-            free(autostart->cmd);
-            free(autostart);
-        }
+bool config_keybind_mods_bound(const turtile_keybind_map_t *map, uint32_t mods) {
+    return mods < KEYBIND_MODS_MAX &&
+        (map->mods[mods / 64] & (UINT64_C(1) << (mods % 64)));
+}
 
-        // Free workspaces
-        turtile_workspace_config_t *workspace, *tmp3;
-        wl_list_for_each_safe(workspace, tmp3, &config_instance->workspaces, link) {
-            free(workspace->name);
-            free(workspace);
-        }
+turtile_keybind_t *config_find_keybind(const turtile_keybind_map_t *map,
+                                       uint32_t mods, xkb_keysym_t key) {
+    if (!map->table || !config_keybind_mods_bound(map, mods))
+        return NULL;
+    return *keybind_slot(map->table, map->table_size, mods, key);
+}
 
-		// Free background color
-		free(config_instance->backgroundColor);
+static turtile_config_t *config_create(void) {
+    // The config is the first allocation of its own arena
+    struct turtile_arena arena = {0};
+    turtile_config_t *config = arena_alloc(&arena, sizeof(turtile_config_t));
+    if (!config) {
+        return NULL;
+    }
+    config->arena = arena;
+    config->backgroundColor[3] = 1.0;
+    config->keyboard.repeat_rate = 25;
+    config->keyboard.repeat_delay = 600;
+    return config;
+}
 
-        free(config_instance);
-        config_instance = NULL;
+turtile_config_t *config_get_instance(void) {
+    turtile_config_t *config =
+        __atomic_load_n(&config_instance, __ATOMIC_ACQUIRE);
+    if (!config) {
+        config = config_create();
+        __atomic_store_n(&config_instance, config, __ATOMIC_RELEASE);
     }
+    return config;
+}
+
+turtile_config_t *config_swap_instance(turtile_config_t *config) {
+    return __atomic_exchange_n(&config_instance, config, __ATOMIC_ACQ_REL);
+}
+
+void config_release(turtile_config_t *config) {
+    if (!config)
+        return;
+
+    // The arena is freed from a copy, as it holds the config itself
+    struct turtile_arena arena = config->arena;
+    arena_finish(&arena);
+}
+
+void config_free_instance(void) {
+    config_release(config_swap_instance(NULL));
 }
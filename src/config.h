@@ -26,40 +26,105 @@
 #include <xkbcommon/xkbcommon.h>
 #include <wayland-util.h> 
 #include <libconfig.h>
+#include <stdbool.h>
+#include "src/arena.h"
 
+struct keybind_map;
+
+// Each generation of the config is allocated from one arena, which holds the
+// turtile_config_t itself, its arrays and its interned strings. Releasing a
+// generation frees the arena at once.
+
+// Keybinds and autostart entries either run a shell command, given as "cmd",
+// or a turtile command executed in the compositor, given as "command".
+// Keybinds may instead lead to the next keys of a chord, given as "then", and
+// may enter a mode, given as "mode".
 typedef struct keybind {
 	uint32_t mods; // bitmask of modifier keys 
     xkb_keysym_t key;
-    char *cmd;
-    struct wl_list link;
+    const char *cmd; // NULL if the keybind only leads to other keys or a mode
+    bool internal; // cmd is a turtile command
+    struct keybind_map *then; // keys completing the chord, NULL if complete
+    const char *mode_name; // mode entered, NULL to stay in the current mode
+    struct keybind_map *mode; // keybinds of mode_name, once loaded
 } turtile_keybind_t;
 
 typedef struct autostart {
-    char *cmd;
-    struct wl_list link;
+    const char *cmd;
+    bool internal; // cmd is a turtile command
+    const char *workspace; // where the first window goes, NULL for the active one
 } turtile_autostart_t;
 
 typedef struct workspace {
-    char *name;
-    struct wl_list link;
+    const char *name;
 } turtile_workspace_config_t;
 
+typedef struct keyboard_config {
+    // RMLVO names of the keymap, NULL for the xkbcommon defaults
+    const char *rules;
+    const char *model;
+    const char *layout;
+    const char *variant;
+    const char *options;
+    int repeat_rate; // keys per second
+    int repeat_delay; // milliseconds before repeating
+} turtile_keyboard_config_t;
+
+#define KEYBIND_MODS_MAX 256 // modifier masks are made of the 8 WLR_MODIFIER bits
+#define KEYBIND_CHORD_MAX 8 // keys in a chord
+
+// Keybinds matched against the same key press: the top level ones, those of
+// a mode or those completing a chord. Each map is a state of the keyboard,
+// indexed so that a key press is a single lookup.
+typedef struct keybind_map {
+    turtile_keybind_t *keybinds; // in the order of the config file
+    size_t keybind_count;
+    // Open addressing hash table of the keybinds, keyed on their modifiers
+    // and key. Built once the config is loaded, kept at most half full.
+    turtile_keybind_t **table;
+    size_t table_size;
+    // bitset of the modifier masks used by at least one keybind
+    uint64_t mods[KEYBIND_MODS_MAX / 64];
+} turtile_keybind_map_t;
+
+typedef struct mode {
+    const char *name;
+    turtile_keybind_map_t keybinds;
+} turtile_mode_config_t;
+
+#define KEYBIND_DEFAULT_MODE "default" // name of the top level keybinds
+
 typedef struct config {
-    struct wl_list keybinds;
-    struct wl_list autostart;
-    struct wl_list workspaces;
-	float *backgroundColor;
+    struct turtile_arena arena; // holds everything the config points to
+
+    turtile_keybind_map_t keybinds;
+    turtile_mode_config_t *modes; // in the order of the config file
+    size_t mode_count;
+    turtile_autostart_t *autostart; // in the order of the config file
+    size_t autostart_count;
+    turtile_workspace_config_t *workspaces; // in the order of the config file
+    size_t workspace_count;
+	float backgroundColor[4];
+    turtile_keyboard_config_t keyboard;
+    bool reload_on_change; // reload the file when it is written
+
+    const char *path; // absolute path of the file, NULL if none was loaded
 } turtile_config_t;
 
 typedef struct {
     const char *name;
-    void (*load)(config_t *cfg, const char *value);
+    void (*load)(turtile_config_t *config, config_t *cfg, const char *value);
 } config_param_t;
 
-void load_keybinds(config_t *cfg, const char *value);
-void load_autostart(config_t *cfg, const char *value);
-void load_workspaces(config_t *cfg, const char *value);
-void load_background_color(config_t *cfg, const char *value);
+void load_keybinds(turtile_config_t *config, config_t *cfg, const char *value);
+void load_modes(turtile_config_t *config, config_t *cfg, const char *value);
+void load_autostart(turtile_config_t *config, config_t *cfg, const char *value);
+void load_workspaces(turtile_config_t *config, config_t *cfg, const char *value);
+void load_background_color(turtile_config_t *config, config_t *cfg,
+                           const char *value);
+void load_keyboard(turtile_config_t *config, config_t *cfg, const char *value);
+void load_reload_on_change(turtile_config_t *config, config_t *cfg,
+                           const char *value);
 
 /**
  * Returns the singleton instance of the configuration.
@@ -82,4 +147,63 @@ void config_free_instance(void);
  */
 void config_load_from_file(const char *filepath);
 
+/**
+ * Reads a configuration from a file, without touching the global instance.
+ *
+ * @param filepath The file path to load the configuration from
+ * @param error Filled with the reason of a failure
+ * @param size The size of |error|
+ * @return The configuration, or NULL if the file cannot be read
+ */
+turtile_config_t *config_parse(const char *filepath, char *error, size_t size);
+
+/**
+ * Makes a configuration the global instance. The pointer is swapped
+ * atomically, so the instance is always a whole generation.
+ *
+ * @param config The new configuration
+ * @return The previous instance, to release once nothing refers to it
+ */
+turtile_config_t *config_swap_instance(turtile_config_t *config);
+
+/**
+ * Frees a configuration that is not the global instance, along with all it
+ * holds.
+ *
+ * @param config The configuration, may be NULL
+ */
+void config_release(turtile_config_t *config);
+
+/**
+ * Finds the keybinds of a mode by name.
+ *
+ * @param config The configuration.
+ * @param name The name of the mode, KEYBIND_DEFAULT_MODE for the top level.
+ * @return The keybinds of the mode, or NULL if there is no such mode.
+ */
+turtile_keybind_map_t *config_find_mode(turtile_config_t *config,
+                                        const char *name);
+
+/**
+ * Checks whether any keybind of a map uses exactly these modifiers. Keys
+ * pressed with other modifiers can go to the client without looking for a
+ * keybind.
+ *
+ * @param map The keybinds of the current mode or chord.
+ * @param mods The modifiers currently pressed.
+ * @return true if a keybind may match.
+ */
+bool config_keybind_mods_bound(const turtile_keybind_map_t *map, uint32_t mods);
+
+/**
+ * Finds the keybind of a key pressed with some modifiers.
+ *
+ * @param map The keybinds of the current mode or chord.
+ * @param mods The modifiers currently pressed.
+ * @param key The keysym of the key.
+ * @return The keybind, or NULL if the key is not bound.
+ */
+turtile_keybind_t *config_find_keybind(const turtile_keybind_map_t *map,
+                                       uint32_t mods, xkb_keysym_t key);
+
 #endif // TURTILE_CONFIG_H
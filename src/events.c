@@ -0,0 +1,181 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "events.h"
+#include "commands.h"
+#include "json_writer.h"
+#include "socket_server.h"
+#include "src/server.h"
+#include "src/toplevel.h"
+#include "src/workspace.h"
+#include "wlr/util/log.h"
+#include <string.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+static const struct {
+    const char *name;
+    uint32_t type;
+} event_names[] = {
+    {"window", TURTILE_EVENT_WINDOW},
+    {"focus", TURTILE_EVENT_FOCUS},
+    {"workspace", TURTILE_EVENT_WORKSPACE},
+};
+
+uint32_t event_type_from_name(const char *name) {
+    for (size_t i = 0; i < sizeof(event_names) / sizeof(event_names[0]); i++) {
+        if (strcmp(event_names[i].name, name) == 0)
+            return event_names[i].type;
+    }
+    return 0;
+}
+
+// Events are serialized one at a time into this buffer, which is reused
+static struct turtile_buffer event_buffer;
+
+/**
+ * Sends an event to the clients subscribed to its type. The event is
+ * serialized once for each encoding used by those clients, as an object
+ * holding the sequence number, the name of the event and the members written
+ * by |write_members|.
+ */
+static void event_send(struct turtile_server *server, uint32_t type,
+                       const char *name,
+                       void (*write_members)(struct json_writer *, void *),
+                       void *data) {
+    struct turtile_socket_server *socket_server = server->socket_server;
+    uint32_t formats = socket_server_subscriber_formats(socket_server, type);
+    if (formats == 0)
+        return;
+
+    uint64_t seq = ++socket_server->event_seq;
+    for (int format = 0; format < JSON_WRITER_FORMATS; format++) {
+        if (!(formats & (1u << format)))
+            continue;
+
+        struct json_writer writer;
+        event_buffer.len = 0;
+        event_buffer.failed = false;
+        json_writer_init(&writer, &event_buffer, format);
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, "seq");
+        json_writer_int(&writer, seq);
+        json_writer_key(&writer, "event");
+        json_writer_string(&writer, name);
+        write_members(&writer, data);
+        json_writer_end_object(&writer);
+
+        if (event_buffer.failed) {
+            wlr_log(WLR_ERROR, "Failed to allocate memory for an event");
+            continue;
+        }
+        socket_server_broadcast(socket_server, type, format, event_buffer.data,
+                                event_buffer.len);
+    }
+}
+
+struct window_event {
+    const char *change;
+    struct turtile_toplevel *toplevel;
+};
+
+static void write_window_event(struct json_writer *writer, void *data) {
+    struct window_event *event = data;
+    json_writer_key(writer, "change");
+    json_writer_string(writer, event->change);
+    json_writer_key(writer, "window");
+    write_window(writer, event->toplevel);
+}
+
+void emit_window_event(struct turtile_server *server, const char *change,
+                       struct turtile_toplevel *toplevel) {
+    struct window_event event = {
+        .change = change,
+        .toplevel = toplevel,
+    };
+    event_send(server, TURTILE_EVENT_WINDOW, "window", write_window_event,
+               &event);
+}
+
+static void handle_title_task(struct turtile_task *task,
+                              const struct timespec *deadline) {
+    struct turtile_server *server = wl_container_of(task, server, title_task);
+
+    struct turtile_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link) {
+        if (toplevel->title_event_pending) {
+            toplevel->title_event_pending = false;
+            emit_window_event(server, "title", toplevel);
+        }
+    }
+}
+
+void schedule_title_event(struct turtile_toplevel *toplevel) {
+    struct turtile_server *server = toplevel->server;
+    if (!socket_server_has_subscribers(server->socket_server,
+                                       TURTILE_EVENT_WINDOW))
+        return;
+
+    toplevel->title_event_pending = true;
+    scheduler_add(server->scheduler, &server->title_task);
+}
+
+void events_init(struct turtile_server *server) {
+    turtile_task_init(&server->title_task, TASK_PRIORITY_HOUSEKEEPING,
+                      handle_title_task);
+}
+
+static void write_focus_event(struct json_writer *writer, void *data) {
+    json_writer_key(writer, "window");
+    write_window(writer, data);
+}
+
+void emit_focus_event(struct turtile_server *server,
+                      struct turtile_toplevel *toplevel) {
+    event_send(server, TURTILE_EVENT_FOCUS, "focus", write_focus_event,
+               toplevel);
+}
+
+struct workspace_event {
+    struct turtile_workspace *old;
+    struct turtile_workspace *current;
+};
+
+static void write_workspace_event(struct json_writer *writer, void *data) {
+    struct workspace_event *event = data;
+    json_writer_key(writer, "change");
+    json_writer_string(writer, "switch");
+    json_writer_key(writer, "old");
+    json_writer_string(writer, event->old ? event->old->name : NULL);
+    json_writer_key(writer, "current");
+    json_writer_string(writer, event->current->name);
+}
+
+void emit_workspace_event(struct turtile_server *server,
+                          struct turtile_workspace *old,
+                          struct turtile_workspace *current) {
+    struct workspace_event event = {
+        .old = old,
+        .current = current,
+    };
+    event_send(server, TURTILE_EVENT_WORKSPACE, "workspace",
+               write_workspace_event, &event);
+}
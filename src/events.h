@@ -0,0 +1,96 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_EVENTS_H
+#define TURTILE_EVENTS_H
+
+#include "server.h"
+#include <stdint.h>
+
+struct turtile_toplevel;
+struct turtile_workspace;
+
+enum turtile_event_type {
+    TURTILE_EVENT_WINDOW = 1 << 0,
+    TURTILE_EVENT_FOCUS = 1 << 1,
+    TURTILE_EVENT_WORKSPACE = 1 << 2,
+};
+
+#define TURTILE_EVENT_ALL \
+    (TURTILE_EVENT_WINDOW | TURTILE_EVENT_FOCUS | TURTILE_EVENT_WORKSPACE)
+
+/**
+ * Parses the name of an event type as given to the subscribe command.
+ *
+ * @param name The name of the event type ("window", "focus", "workspace").
+ * @return The matching turtile_event_type, or 0 if the name is unknown.
+ */
+uint32_t event_type_from_name(const char *name);
+
+/**
+ * Sends a window event to every client subscribed to window events.
+ *
+ * @param server The turtile server the window belongs to.
+ * @param change What happened to the window ("map", "unmap", "title", "move").
+ * @param toplevel The window that changed.
+ */
+void emit_window_event(struct turtile_server *server, const char *change,
+                       struct turtile_toplevel *toplevel);
+
+/**
+ * Marks the title of a window as changed. Title changes are coalesced, all
+ * the changes made during one iteration of the event loop produce a single
+ * "title" window event per window.
+ *
+ * @param toplevel The window whose title changed.
+ */
+void schedule_title_event(struct turtile_toplevel *toplevel);
+
+/**
+ * Prepares the deferred sending of events, once the scheduler of the server
+ * exists.
+ *
+ * @param server The server.
+ */
+void events_init(struct turtile_server *server);
+
+/**
+ * Sends a focus event to every client subscribed to focus events.
+ *
+ * @param server The turtile server the window belongs to.
+ * @param toplevel The window that received keyboard focus.
+ */
+void emit_focus_event(struct turtile_server *server,
+                      struct turtile_toplevel *toplevel);
+
+/**
+ * Sends a workspace event to every client subscribed to workspace events.
+ *
+ * @param server The turtile server the workspaces belong to.
+ * @param old The previously active workspace, may be NULL.
+ * @param current The newly active workspace.
+ */
+void emit_workspace_event(struct turtile_server *server,
+                          struct turtile_workspace *old,
+                          struct turtile_workspace *current);
+
+#endif // TURTILE_EVENTS_H
@@ -0,0 +1,118 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_IPC_H
+#define TURTILE_IPC_H
+
+#include <stdint.h>
+
+/*
+ * Wire protocol shared by the compositor and its clients.
+ *
+ * A client may keep its connection open and send any number of requests
+ * without waiting for the replies. Every message, in both directions, is a
+ * turtile_ipc_header followed by |length| bytes of payload. Requests carry
+ * the command as text (not null-terminated) and a client chosen id, the
+ * server answers every request in order with a reply carrying the same id.
+ *
+ * Id 0 is reserved for events pushed by the server to clients that ran the
+ * subscribe command, clients should number their requests from 1. The
+ * events caused by a command are sent after its reply.
+ *
+ * A request longer than MAX_MSG_SIZE gets an error reply, after which the
+ * server closes the connection without reading the rest of it.
+ *
+ * Replies and events are JSON text by default. The "encoding msgpack"
+ * command switches the connection to MessagePack, carrying the same data
+ * ("encoding json" switches back). The reply to the encoding command itself
+ * still uses the previous encoding, every frame after it uses the new one.
+ *
+ * "wait [--timeout MS] COMMAND" runs COMMAND and holds its reply until every
+ * window has committed the configure of the new layout and an output has
+ * shown the next frame. The reply is {"result": <reply of COMMAND>, "wait":
+ * {"ms": <time waited>, "timed_out": <bool>}}, events raised meanwhile are
+ * held until it has been sent. The following requests of the connection are
+ * only processed once it has been sent.
+ */
+
+#define SOCKET_PATH "/tmp/turtile_socket"
+// Max size of a request, room for a batch or an apply document of a few
+// hundred windows. Replies have no limit.
+#define MAX_MSG_SIZE (64 * 1024)
+
+struct turtile_ipc_header {
+    uint32_t length; // size of the payload that follows the header
+    uint32_t id;     // request id, echoed back in the reply, 0 for events
+};
+
+/*
+ * Shared memory snapshot of the compositor state.
+ *
+ * The reply to the "snapshot" command carries a read-only memfd as SCM_RIGHTS
+ * ancillary data, attached to the first byte of the reply. It only needs to
+ * be requested and mapped once, the compositor keeps it up to date.
+ *
+ * The file starts with a turtile_snapshot_header, followed by the workspaces,
+ * the windows and the focus order at the offsets given in the header. It
+ * never shrinks, but it grows when the state doesn't fit anymore: when |size|
+ * is larger than the mapping, map the file again.
+ *
+ * The compositor updates the snapshot in place, guarded by a sequence lock.
+ * Readers load |seq| with acquire semantics and retry while it is odd, copy
+ * what they need, then issue an acquire fence and retry if |seq| changed.
+ * Strings are null-terminated and truncated to fit their field.
+ */
+
+#define TURTILE_SNAPSHOT_MAGIC 0x70736e74 // "tnsp"
+#define TURTILE_SNAPSHOT_VERSION 1
+#define TURTILE_SNAPSHOT_NONE UINT32_MAX // no focused window
+
+struct turtile_snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;  // odd while the compositor is updating the snapshot
+    uint32_t size; // size of the file in bytes
+    uint32_t workspace_count;
+    uint32_t workspaces_offset;  // array of turtile_snapshot_workspace
+    uint32_t window_count;
+    uint32_t windows_offset;     // array of turtile_snapshot_window
+    uint32_t focus_order_offset; // uint32_t window indices, most recent first
+    uint32_t focused; // index of the focused window or TURTILE_SNAPSHOT_NONE
+};
+
+struct turtile_snapshot_workspace {
+    char name[128];
+    uint32_t active;
+};
+
+struct turtile_snapshot_window {
+    char id[16];
+    char app_id[128];
+    char title[256];
+    char workspace[128];
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+#endif // TURTILE_IPC_H
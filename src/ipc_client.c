@@ -0,0 +1,442 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "ipc_client.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define IPC_CLIENT_READ_SIZE 65536 // free space made before each read
+
+struct turtile_ipc_client *ipc_client_connect(const char *path) {
+    struct sockaddr_un address = {
+        .sun_family = AF_UNIX,
+    };
+
+    if (!path)
+        path = SOCKET_PATH;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    strcpy(address.sun_path, path);
+
+    struct turtile_ipc_client *client = calloc(1, sizeof(*client));
+    if (!client)
+        return NULL;
+    client->next_id = 1;
+    client->encoding = JSON_WRITER_TEXT;
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd == -1) {
+        free(client);
+        return NULL;
+    }
+    // Connect while blocking, a local connect only fails right away
+    if (connect(client->fd, (struct sockaddr *)&address,
+                sizeof(address)) == -1 ||
+        fcntl(client->fd, F_SETFL, O_NONBLOCK) == -1) {
+        int error = errno;
+        close(client->fd);
+        free(client);
+        errno = error;
+        return NULL;
+    }
+    return client;
+}
+
+void ipc_client_destroy(struct turtile_ipc_client *client) {
+    if (!client)
+        return;
+    close(client->fd);
+    buffer_finish(&client->out);
+    buffer_finish(&client->in);
+    free(client);
+}
+
+uint32_t ipc_client_queue(struct turtile_ipc_client *client,
+                          const char *command) {
+    size_t length = strlen(command);
+    if (length > MAX_MSG_SIZE)
+        return 0;
+
+    struct turtile_ipc_header header = {
+        .length = length,
+        .id = client->next_id,
+    };
+    if (!buffer_reserve(&client->out, sizeof(header) + length))
+        return 0;
+    buffer_append(&client->out, &header, sizeof(header));
+    buffer_append(&client->out, command, length);
+
+    // Id 0 is reserved for events
+    if (++client->next_id == 0)
+        client->next_id = 1;
+    return header.id;
+}
+
+uint32_t ipc_client_set_encoding(struct turtile_ipc_client *client,
+                                 enum json_writer_format format) {
+    uint32_t id = ipc_client_queue(client, format == JSON_WRITER_MSGPACK ?
+                                   "encoding msgpack" : "encoding json");
+    if (id != 0) {
+        client->encoding_id = id;
+        client->next_encoding = format;
+    }
+    return id;
+}
+
+int ipc_client_flush(struct turtile_ipc_client *client) {
+    while (client->out_sent < client->out.len) {
+        ssize_t n = send(client->fd, client->out.data + client->out_sent,
+                         client->out.len - client->out_sent, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            return -1;
+        }
+        client->out_sent += n;
+    }
+    client->out.len = client->out_sent = 0;
+    return 0;
+}
+
+bool ipc_client_pending(const struct turtile_ipc_client *client) {
+    return client->out_sent < client->out.len;
+}
+
+int ipc_client_read(struct turtile_ipc_client *client) {
+    // Drop the messages already taken, the payloads handed out go stale
+    if (client->in_start > 0) {
+        memmove(client->in.data, client->in.data + client->in_start,
+                client->in.len - client->in_start);
+        client->in.len -= client->in_start;
+        client->in_start = 0;
+    }
+
+    if (!buffer_reserve(&client->in, IPC_CLIENT_READ_SIZE))
+        return -1;
+
+    ssize_t n;
+    do {
+        n = recv(client->fd, client->in.data + client->in.len,
+                 client->in.cap - client->in.len, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    if (n == -1)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    client->in.len += n;
+    return 0;
+}
+
+bool ipc_client_next(struct turtile_ipc_client *client,
+                     struct turtile_ipc_message *message) {
+    struct turtile_ipc_header header;
+    size_t available = client->in.len - client->in_start;
+
+    if (available < sizeof(header))
+        return false;
+    memcpy(&header, client->in.data + client->in_start, sizeof(header));
+    if (available - sizeof(header) < header.length)
+        return false;
+
+    message->id = header.id;
+    message->format = client->encoding;
+    message->payload = client->in.data + client->in_start + sizeof(header);
+    message->length = header.length;
+    client->in_start += sizeof(header) + header.length;
+
+    // The reply to an encoding command is the last one in the old encoding
+    if (header.id != 0 && header.id == client->encoding_id) {
+        client->encoding_id = 0;
+        if (!ipc_message_is_error(message))
+            client->encoding = client->next_encoding;
+    }
+    return true;
+}
+
+bool ipc_client_recv(struct turtile_ipc_client *client,
+                     struct turtile_ipc_message *message) {
+    while (!ipc_client_next(client, message)) {
+        int flushed = ipc_client_flush(client);
+        if (flushed == -1)
+            return false;
+
+        struct pollfd pollfd = {
+            .fd = client->fd,
+            .events = POLLIN | (flushed == 1 ? POLLOUT : 0),
+        };
+        if (poll(&pollfd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if ((pollfd.revents & (POLLIN | POLLHUP | POLLERR)) &&
+            ipc_client_read(client) == -1)
+            return false;
+    }
+    return true;
+}
+
+bool ipc_client_command(struct turtile_ipc_client *client, const char *command,
+                        struct turtile_ipc_message *reply) {
+    uint32_t id = ipc_client_queue(client, command);
+    if (id == 0)
+        return false;
+
+    do {
+        if (!ipc_client_recv(client, reply))
+            return false;
+    } while (reply->id != id);
+    return true;
+}
+
+bool ipc_message_is_error(const struct turtile_ipc_message *message) {
+    if (message->format == JSON_WRITER_TEXT)
+        return message->length >= 8 &&
+            memcmp(message->payload, "{\"error\"", 8) == 0;
+
+    struct msgpack_reader reader;
+    struct msgpack_value value;
+    msgpack_reader_init(&reader, message);
+    return msgpack_next(&reader, &value) && value.type == MSGPACK_MAP &&
+        value.count > 0 && msgpack_next(&reader, &value) &&
+        msgpack_str_equals(&value, "error");
+}
+
+/**
+ * Convert a MessagePack value to JSON text.
+ */
+static bool msgpack_to_json(struct msgpack_reader *reader,
+                            struct json_writer *writer, int depth) {
+    struct msgpack_value value;
+
+    if (depth > IPC_CLIENT_MAX_DEPTH || !msgpack_next(reader, &value))
+        return false;
+
+    switch (value.type) {
+    case MSGPACK_NIL:
+        json_writer_null(writer);
+        break;
+    case MSGPACK_BOOL:
+        json_writer_bool(writer, value.boolean);
+        break;
+    case MSGPACK_INT:
+        json_writer_int(writer, value.integer);
+        break;
+    case MSGPACK_FLOAT: {
+        char number[32];
+        int size = snprintf(number, sizeof(number), "%.17g", value.real);
+        json_writer_raw(writer, number, size);
+        break;
+    }
+    case MSGPACK_STR:
+        json_writer_stringf(writer, "%.*s", (int)value.str.size,
+                            value.str.data);
+        break;
+    case MSGPACK_MAP:
+        json_writer_begin_object(writer);
+        for (uint32_t i = 0; i < value.count; i++) {
+            struct msgpack_value key;
+            if (!msgpack_next(reader, &key) || key.type != MSGPACK_STR)
+                return false;
+            char *name = strndup(key.str.data, key.str.size);
+            if (!name)
+                return false;
+            json_writer_key(writer, name);
+            free(name);
+            if (!msgpack_to_json(reader, writer, depth + 1))
+                return false;
+        }
+        json_writer_end_object(writer);
+        break;
+    case MSGPACK_ARRAY:
+        json_writer_begin_array(writer);
+        for (uint32_t i = 0; i < value.count; i++) {
+            if (!msgpack_to_json(reader, writer, depth + 1))
+                return false;
+        }
+        json_writer_end_array(writer);
+        break;
+    }
+    return true;
+}
+
+bool ipc_message_to_json(const struct turtile_ipc_message *message,
+                         struct turtile_buffer *json) {
+    if (message->format == JSON_WRITER_TEXT) {
+        buffer_append(json, message->payload, message->length);
+        return !json->failed;
+    }
+
+    struct msgpack_reader reader;
+    struct json_writer writer;
+    msgpack_reader_init(&reader, message);
+    json_writer_init(&writer, json, JSON_WRITER_TEXT);
+    return msgpack_to_json(&reader, &writer, 0) &&
+        reader.offset == reader.size && !json->failed;
+}
+
+void msgpack_reader_init(struct msgpack_reader *reader,
+                         const struct turtile_ipc_message *message) {
+    reader->data = (const unsigned char *)message->payload;
+    reader->size = message->length;
+    reader->offset = 0;
+    reader->failed = false;
+}
+
+/**
+ * Read a big endian unsigned integer of |size| bytes.
+ */
+static uint64_t msgpack_read_uint(struct msgpack_reader *reader, int size) {
+    uint64_t value = 0;
+
+    if (reader->size - reader->offset < (size_t)size) {
+        reader->failed = true;
+        return 0;
+    }
+    for (int i = 0; i < size; i++)
+        value = value << 8 | reader->data[reader->offset++];
+    return value;
+}
+
+static void msgpack_read_str(struct msgpack_reader *reader,
+                             struct msgpack_value *value, uint32_t size) {
+    value->type = MSGPACK_STR;
+    if (reader->size - reader->offset < size) {
+        reader->failed = true;
+        return;
+    }
+    value->str.data = (const char *)reader->data + reader->offset;
+    value->str.size = size;
+    reader->offset += size;
+}
+
+bool msgpack_next(struct msgpack_reader *reader, struct msgpack_value *value) {
+    uint8_t type = msgpack_read_uint(reader, 1);
+    if (reader->failed)
+        return false;
+
+    if (type <= 0x7f || type >= 0xe0) {
+        value->type = MSGPACK_INT;
+        value->integer = (int8_t)type;
+        if (type <= 0x7f)
+            value->integer = type;
+    } else if ((type & 0xe0) == 0xa0) {
+        msgpack_read_str(reader, value, type & 0x1f);
+    } else if ((type & 0xf0) == 0x90) {
+        value->type = MSGPACK_ARRAY;
+        value->count = type & 0x0f;
+    } else if ((type & 0xf0) == 0x80) {
+        value->type = MSGPACK_MAP;
+        value->count = type & 0x0f;
+    } else {
+        switch (type) {
+        case 0xc0: value->type = MSGPACK_NIL; break;
+        case 0xc2: case 0xc3:
+            value->type = MSGPACK_BOOL;
+            value->boolean = type == 0xc3;
+            break;
+        case 0xca: case 0xcb: {
+            value->type = MSGPACK_FLOAT;
+            uint64_t bits = msgpack_read_uint(reader, type == 0xca ? 4 : 8);
+            if (type == 0xca) {
+                float real;
+                uint32_t bits32 = bits;
+                memcpy(&real, &bits32, sizeof(real));
+                value->real = real;
+            } else {
+                memcpy(&value->real, &bits, sizeof(value->real));
+            }
+            break;
+        }
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            value->type = MSGPACK_INT;
+            value->integer = msgpack_read_uint(reader, 1 << (type - 0xcc));
+            break;
+        case 0xd0:
+            value->type = MSGPACK_INT;
+            value->integer = (int8_t)msgpack_read_uint(reader, 1);
+            break;
+        case 0xd1:
+            value->type = MSGPACK_INT;
+            value->integer = (int16_t)msgpack_read_uint(reader, 2);
+            break;
+        case 0xd2:
+            value->type = MSGPACK_INT;
+            value->integer = (int32_t)msgpack_read_uint(reader, 4);
+            break;
+        case 0xd3:
+            value->type = MSGPACK_INT;
+            value->integer = (int64_t)msgpack_read_uint(reader, 8);
+            break;
+        case 0xd9: case 0xda: case 0xdb:
+            msgpack_read_str(reader, value,
+                             msgpack_read_uint(reader, 1 << (type - 0xd9)));
+            break;
+        case 0xdc: case 0xdd:
+            value->type = MSGPACK_ARRAY;
+            value->count = msgpack_read_uint(reader, type == 0xdc ? 2 : 4);
+            break;
+        case 0xde: case 0xdf:
+            value->type = MSGPACK_MAP;
+            value->count = msgpack_read_uint(reader, type == 0xde ? 2 : 4);
+            break;
+        default: // bin and ext are never sent by turtile
+            reader->failed = true;
+        }
+    }
+    return !reader->failed;
+}
+
+bool msgpack_skip(struct msgpack_reader *reader) {
+    struct msgpack_value value;
+    // Values left to skip, a map entry counts as two
+    uint64_t remaining = 1;
+
+    while (remaining > 0) {
+        if (!msgpack_next(reader, &value))
+            return false;
+        remaining--;
+        if (value.type == MSGPACK_ARRAY)
+            remaining += value.count;
+        else if (value.type == MSGPACK_MAP)
+            remaining += 2 * (uint64_t)value.count;
+    }
+    return true;
+}
+
+bool msgpack_str_equals(const struct msgpack_value *value, const char *str) {
+    return value->type == MSGPACK_STR && strlen(str) == value->str.size &&
+        memcmp(value->str.data, str, value->str.size) == 0;
+}
@@ -0,0 +1,236 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_IPC_CLIENT_H
+#define TURTILE_IPC_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ipc.h"
+#include "json_writer.h"
+
+/*
+ * Client side of the IPC protocol described in ipc.h, built as the
+ * libturtile-ipc shared library used by ttcli and ttcli-bench.
+ *
+ * A connection is meant to be kept open for many requests. Requests are
+ * queued with ipc_client_queue() and written together, without waiting for
+ * the replies of the previous ones, and replies are read back in order. The
+ * socket is non-blocking: ipc_client_recv() and ipc_client_command() poll
+ * until a message is complete, programs with their own poll loop use
+ * ipc_client_flush(), ipc_client_read() and ipc_client_next() instead.
+ */
+
+#define IPC_CLIENT_MAX_DEPTH 64 // deepest nesting accepted when decoding
+
+struct turtile_ipc_client {
+    int fd;
+    uint32_t next_id; // id of the next request, never 0
+
+    struct turtile_buffer out; // queued requests not accepted by the socket
+    size_t out_sent;
+    struct turtile_buffer in; // received messages, the unread ones after
+    size_t in_start;          // |in_start|
+
+    enum json_writer_format encoding; // of the next message received
+    // encoding of the messages following the reply to |encoding_id|, if
+    // that reply is not an error
+    uint32_t encoding_id;
+    enum json_writer_format next_encoding;
+};
+
+/**
+ * A reply or an event, as returned by ipc_client_next(). The payload points
+ * into the buffer of the client and is only valid until the next call to
+ * ipc_client_read(), ipc_client_recv() or ipc_client_command().
+ */
+struct turtile_ipc_message {
+    uint32_t id; // id of the request, 0 for events
+    enum json_writer_format format;
+    const char *payload;
+    size_t length;
+};
+
+/**
+ * Connect to the compositor.
+ *
+ * @param path The socket to connect to, SOCKET_PATH if NULL.
+ * @return The connection, or NULL with errno set.
+ */
+struct turtile_ipc_client *ipc_client_connect(const char *path);
+
+/**
+ * Close the connection and free the client, queued requests are dropped.
+ *
+ * @param client The client, may be NULL.
+ */
+void ipc_client_destroy(struct turtile_ipc_client *client);
+
+/**
+ * Queue a request, it is only sent by the functions doing I/O.
+ *
+ * @param client The client.
+ * @param command The command, as typed on the command line of ttcli.
+ * @return The id of the request, or 0 if the command is longer than
+ *         MAX_MSG_SIZE or memory ran out.
+ */
+uint32_t ipc_client_queue(struct turtile_ipc_client *client,
+                          const char *command);
+
+/**
+ * Queue an encoding command. The replies and events following its reply
+ * are decoded in the new encoding, unless that reply is an error.
+ *
+ * @param client The client.
+ * @param format The encoding to switch to.
+ * @return The id of the request, or 0 if memory ran out.
+ */
+uint32_t ipc_client_set_encoding(struct turtile_ipc_client *client,
+                                 enum json_writer_format format);
+
+/**
+ * Write as much of the queued requests as the socket accepts.
+ *
+ * @return 0 once everything is sent, 1 if the socket is full, -1 on error.
+ */
+int ipc_client_flush(struct turtile_ipc_client *client);
+
+/**
+ * Check whether queued requests are waiting for the socket to be writable.
+ */
+bool ipc_client_pending(const struct turtile_ipc_client *client);
+
+/**
+ * Read what the socket has available, without blocking.
+ *
+ * @return 0 on success, -1 on error or if the compositor closed the
+ *         connection.
+ */
+int ipc_client_read(struct turtile_ipc_client *client);
+
+/**
+ * Take the next complete message out of what has been read, without doing
+ * any I/O.
+ *
+ * @param client The client.
+ * @param message Filled with the message.
+ * @return false if no complete message has been read yet.
+ */
+bool ipc_client_next(struct turtile_ipc_client *client,
+                     struct turtile_ipc_message *message);
+
+/**
+ * Send the queued requests and wait for the next message, reply or event.
+ *
+ * @return false on error or if the compositor closed the connection.
+ */
+bool ipc_client_recv(struct turtile_ipc_client *client,
+                     struct turtile_ipc_message *message);
+
+/**
+ * Send a command and wait for its reply. Events and the replies of requests
+ * queued before it are skipped.
+ *
+ * @return false if the command could not be sent or no reply came back.
+ */
+bool ipc_client_command(struct turtile_ipc_client *client, const char *command,
+                        struct turtile_ipc_message *reply);
+
+/**
+ * Check whether a message is an {"error": ...} reply.
+ */
+bool ipc_message_is_error(const struct turtile_ipc_message *message);
+
+/**
+ * Append a message to a buffer as JSON text, converting it if it is
+ * MessagePack.
+ *
+ * @return false if the message is malformed or memory ran out.
+ */
+bool ipc_message_to_json(const struct turtile_ipc_message *message,
+                         struct turtile_buffer *json);
+
+/**
+ * Reader over a MessagePack encoded message.
+ */
+struct msgpack_reader {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+    bool failed; // the message is truncated or uses unsupported types
+};
+
+enum msgpack_type {
+    MSGPACK_NIL,
+    MSGPACK_BOOL,
+    MSGPACK_INT,
+    MSGPACK_FLOAT,
+    MSGPACK_STR,
+    MSGPACK_ARRAY,
+    MSGPACK_MAP,
+};
+
+/**
+ * A decoded MessagePack value. Strings point into the message, for arrays
+ * and maps only the number of entries is decoded, the entries follow.
+ */
+struct msgpack_value {
+    enum msgpack_type type;
+    union {
+        bool boolean;
+        int64_t integer;
+        double real;
+        struct {
+            const char *data;
+            uint32_t size;
+        } str;
+        uint32_t count;
+    };
+};
+
+/**
+ * Start reading a MessagePack message.
+ */
+void msgpack_reader_init(struct msgpack_reader *reader,
+                         const struct turtile_ipc_message *message);
+
+/**
+ * Decode the next value.
+ *
+ * @return false if the message is malformed.
+ */
+bool msgpack_next(struct msgpack_reader *reader, struct msgpack_value *value);
+
+/**
+ * Skip the next value, with all the entries of arrays and maps.
+ *
+ * @return false if the message is malformed.
+ */
+bool msgpack_skip(struct msgpack_reader *reader);
+
+/**
+ * Check whether a decoded string equals a null-terminated one.
+ */
+bool msgpack_str_equals(const struct msgpack_value *value, const char *str);
+
+#endif // TURTILE_IPC_CLIENT_H
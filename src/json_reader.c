@@ -0,0 +1,322 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "json_reader.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+static bool reader_fail(struct json_reader *reader, const char *error) {
+    if (!reader->error)
+        reader->error = error;
+    return false;
+}
+
+static void skip_space(struct json_reader *reader) {
+    reader->pos += strspn(reader->pos, " \t\n\r");
+}
+
+static bool skip_digits(char **pos) {
+    char *start = *pos;
+    while (isdigit((unsigned char)**pos))
+        (*pos)++;
+    return *pos > start;
+}
+
+/**
+ * Parses the 4 hex digits of a \u escape.
+ */
+static bool read_hex4(const char *in, uint32_t *code) {
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = in[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        *code = *code << 4 | digit;
+    }
+    return true;
+}
+
+/**
+ * Writes a code point as UTF-8, never longer than the escape it comes from.
+ */
+static char *put_utf8(char *out, uint32_t code) {
+    if (code < 0x80) {
+        *out++ = code;
+    } else if (code < 0x800) {
+        *out++ = 0xc0 | code >> 6;
+        *out++ = 0x80 | (code & 0x3f);
+    } else if (code < 0x10000) {
+        *out++ = 0xe0 | code >> 12;
+        *out++ = 0x80 | (code >> 6 & 0x3f);
+        *out++ = 0x80 | (code & 0x3f);
+    } else {
+        *out++ = 0xf0 | code >> 18;
+        *out++ = 0x80 | (code >> 12 & 0x3f);
+        *out++ = 0x80 | (code >> 6 & 0x3f);
+        *out++ = 0x80 | (code & 0x3f);
+    }
+    return out;
+}
+
+void json_reader_init(struct json_reader *reader, char *json) {
+    *reader = (struct json_reader){ .pos = json };
+}
+
+enum json_reader_type json_reader_peek(struct json_reader *reader) {
+    if (reader->error)
+        return JSON_READER_INVALID;
+    skip_space(reader);
+    switch (*reader->pos) {
+    case 'n':
+        return JSON_READER_NULL;
+    case 't':
+    case 'f':
+        return JSON_READER_BOOL;
+    case '"':
+        return JSON_READER_STRING;
+    case '{':
+        return JSON_READER_OBJECT;
+    case '[':
+        return JSON_READER_ARRAY;
+    case '-':
+        return JSON_READER_NUMBER;
+    default:
+        if (isdigit((unsigned char)*reader->pos))
+            return JSON_READER_NUMBER;
+        return JSON_READER_INVALID;
+    }
+}
+
+static bool begin_container(struct json_reader *reader, char open,
+                            const char *error) {
+    if (reader->error)
+        return false;
+    skip_space(reader);
+    if (*reader->pos != open)
+        return reader_fail(reader, error);
+    if (reader->depth == JSON_READER_MAX_DEPTH)
+        return reader_fail(reader, "nested too deeply");
+    reader->pos++;
+    reader->depth++;
+    reader->first = true;
+    return true;
+}
+
+static bool next_in_container(struct json_reader *reader, char close) {
+    if (reader->error)
+        return false;
+    skip_space(reader);
+    if (*reader->pos == close) {
+        reader->pos++;
+        reader->depth--;
+        // The container was a value of the enclosing one
+        reader->first = false;
+        return false;
+    }
+    if (!reader->first) {
+        if (*reader->pos != ',')
+            return reader_fail(reader, close == '}' ? "expected ',' or '}'" :
+                               "expected ',' or ']'");
+        reader->pos++;
+    }
+    reader->first = false;
+    return true;
+}
+
+bool json_reader_begin_object(struct json_reader *reader) {
+    return begin_container(reader, '{', "expected an object");
+}
+
+bool json_reader_next_member(struct json_reader *reader, char **key) {
+    if (!next_in_container(reader, '}') || !json_reader_string(reader, key))
+        return false;
+    skip_space(reader);
+    if (*reader->pos != ':')
+        return reader_fail(reader, "expected ':'");
+    reader->pos++;
+    return true;
+}
+
+bool json_reader_begin_array(struct json_reader *reader) {
+    return begin_container(reader, '[', "expected an array");
+}
+
+bool json_reader_next_element(struct json_reader *reader) {
+    return next_in_container(reader, ']');
+}
+
+bool json_reader_string(struct json_reader *reader, char **value) {
+    if (reader->error)
+        return false;
+    skip_space(reader);
+    if (*reader->pos != '"')
+        return reader_fail(reader, "expected a string");
+
+    char *in = reader->pos + 1;
+    char *out = in;
+    *value = out;
+    while (*in != '"') {
+        if ((unsigned char)*in < 0x20) {
+            reader->pos = in;
+            return reader_fail(reader, *in ? "control character in string" :
+                               "unterminated string");
+        }
+        if (*in != '\\') {
+            *out++ = *in++;
+            continue;
+        }
+
+        uint32_t code, low;
+        switch (in[1]) {
+        case '"': case '\\': case '/':
+            *out++ = in[1];
+            break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u':
+            if (!read_hex4(in + 2, &code))
+                goto invalid;
+            in += 4;
+            // Surrogate pairs are combined, lone surrogates kept as they are
+            if (code >= 0xd800 && code < 0xdc00 && in[2] == '\\' &&
+                in[3] == 'u' && read_hex4(in + 4, &low) &&
+                low >= 0xdc00 && low < 0xe000) {
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                in += 6;
+            }
+            out = put_utf8(out, code);
+            break;
+        default:
+            goto invalid;
+        }
+        in += 2;
+    }
+    reader->pos = in + 1;
+    *out = '\0';
+    return true;
+
+invalid:
+    reader->pos = in;
+    return reader_fail(reader, "invalid escape in string");
+}
+
+static bool read_literal(struct json_reader *reader, const char *literal) {
+    size_t len = strlen(literal);
+    if (strncmp(reader->pos, literal, len) != 0)
+        return false;
+    reader->pos += len;
+    return true;
+}
+
+bool json_reader_bool(struct json_reader *reader, bool *value) {
+    if (json_reader_peek(reader) == JSON_READER_BOOL) {
+        if (read_literal(reader, "true")) {
+            *value = true;
+            return true;
+        }
+        if (read_literal(reader, "false")) {
+            *value = false;
+            return true;
+        }
+    }
+    return reader_fail(reader, "expected a boolean");
+}
+
+static bool skip_number(struct json_reader *reader) {
+    char *pos = reader->pos;
+
+    if (*pos == '-')
+        pos++;
+    if (*pos == '0')
+        pos++;
+    else if (!skip_digits(&pos))
+        return reader_fail(reader, "invalid number");
+    if (*pos == '.') {
+        pos++;
+        if (!skip_digits(&pos))
+            return reader_fail(reader, "invalid number");
+    }
+    if (*pos == 'e' || *pos == 'E') {
+        pos++;
+        if (*pos == '+' || *pos == '-')
+            pos++;
+        if (!skip_digits(&pos))
+            return reader_fail(reader, "invalid number");
+    }
+    reader->pos = pos;
+    return true;
+}
+
+bool json_reader_skip(struct json_reader *reader) {
+    char *string;
+    bool boolean;
+
+    switch (json_reader_peek(reader)) {
+    case JSON_READER_NULL:
+        return read_literal(reader, "null") ||
+            reader_fail(reader, "expected a value");
+    case JSON_READER_BOOL:
+        return json_reader_bool(reader, &boolean);
+    case JSON_READER_NUMBER:
+        return skip_number(reader);
+    case JSON_READER_STRING:
+        return json_reader_string(reader, &string);
+    case JSON_READER_OBJECT:
+        if (!json_reader_begin_object(reader))
+            return false;
+        while (json_reader_next_member(reader, &string)) {
+            if (!json_reader_skip(reader))
+                return false;
+        }
+        return !reader->error;
+    case JSON_READER_ARRAY:
+        if (!json_reader_begin_array(reader))
+            return false;
+        while (json_reader_next_element(reader)) {
+            if (!json_reader_skip(reader))
+                return false;
+        }
+        return !reader->error;
+    default:
+        return reader_fail(reader, "expected a value");
+    }
+}
+
+bool json_reader_end(struct json_reader *reader) {
+    if (reader->error)
+        return false;
+    skip_space(reader);
+    if (*reader->pos != '\0')
+        return reader_fail(reader, "unexpected characters after the value");
+    return true;
+}
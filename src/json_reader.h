@@ -0,0 +1,135 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_JSON_READER_H
+#define TURTILE_JSON_READER_H
+
+#include <stdbool.h>
+
+#define JSON_READER_MAX_DEPTH 32 // max nesting of objects and arrays
+
+/**
+ * Types of the JSON values a json_reader can find next.
+ */
+enum json_reader_type {
+    JSON_READER_NULL,
+    JSON_READER_BOOL,
+    JSON_READER_NUMBER,
+    JSON_READER_STRING,
+    JSON_READER_OBJECT,
+    JSON_READER_ARRAY,
+    JSON_READER_INVALID,
+};
+
+/**
+ * Pull parser reading a JSON document in place, the counterpart of
+ * json_writer for the few commands that take JSON arguments. Nothing is
+ * allocated: strings are unescaped inside the document itself, so they stay
+ * valid as long as the document does.
+ *
+ * The caller walks the document in order, entering objects and arrays and
+ * reading or skipping their values. The first syntax error stops the reader,
+ * every later call fails and |error| says what was wrong at |pos|.
+ */
+struct json_reader {
+    char *pos; // next byte to read, the document is NUL terminated
+    int depth;
+    bool first; // nothing has been read yet in the innermost container
+    const char *error; // NULL as long as the document is valid
+};
+
+/**
+ * Starts reading a JSON document. The document is modified while it is read.
+ *
+ * @param reader The reader to initialize.
+ * @param json The NUL terminated document.
+ */
+void json_reader_init(struct json_reader *reader, char *json);
+
+/**
+ * Returns the type of the next value without reading it.
+ */
+enum json_reader_type json_reader_peek(struct json_reader *reader);
+
+/**
+ * Enters the object that is the next value.
+ *
+ * @return false if the next value is not an object.
+ */
+bool json_reader_begin_object(struct json_reader *reader);
+
+/**
+ * Reads the key of the next member of the current object, its value is the
+ * next value to read. Leaves the object after its last member.
+ *
+ * @param reader The reader.
+ * @param key Set to the unescaped key.
+ * @return false at the end of the object or on error.
+ */
+bool json_reader_next_member(struct json_reader *reader, char **key);
+
+/**
+ * Enters the array that is the next value.
+ *
+ * @return false if the next value is not an array.
+ */
+bool json_reader_begin_array(struct json_reader *reader);
+
+/**
+ * Moves to the next element of the current array, which is the next value to
+ * read. Leaves the array after its last element.
+ *
+ * @return false at the end of the array or on error.
+ */
+bool json_reader_next_element(struct json_reader *reader);
+
+/**
+ * Reads a string value.
+ *
+ * @param reader The reader.
+ * @param value Set to the unescaped string.
+ * @return false if the next value is not a string.
+ */
+bool json_reader_string(struct json_reader *reader, char **value);
+
+/**
+ * Reads a boolean value.
+ *
+ * @return false if the next value is not a boolean.
+ */
+bool json_reader_bool(struct json_reader *reader, bool *value);
+
+/**
+ * Reads the next value and ignores it, with everything it contains.
+ *
+ * @return false if the value is invalid.
+ */
+bool json_reader_skip(struct json_reader *reader);
+
+/**
+ * Checks that nothing but whitespace follows the value that was read.
+ *
+ * @return false if the document has trailing characters or an error.
+ */
+bool json_reader_end(struct json_reader *reader);
+
+#endif // TURTILE_JSON_READER_H
@@ -0,0 +1,319 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "json_writer.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool buffer_reserve(struct turtile_buffer *buffer, size_t size) {
+    if (buffer->failed)
+        return false;
+    if (buffer->len + size <= buffer->cap)
+        return true;
+
+    size_t cap = buffer->cap ? buffer->cap : 1024;
+    while (cap < buffer->len + size)
+        cap *= 2;
+    char *data = realloc(buffer->data, cap);
+    if (!data) {
+        buffer->failed = true;
+        return false;
+    }
+    buffer->data = data;
+    buffer->cap = cap;
+    return true;
+}
+
+void buffer_append(struct turtile_buffer *buffer, const void *data, size_t size) {
+    if (!buffer_reserve(buffer, size))
+        return;
+    memcpy(buffer->data + buffer->len, data, size);
+    buffer->len += size;
+}
+
+void buffer_finish(struct turtile_buffer *buffer) {
+    free(buffer->data);
+    *buffer = (struct turtile_buffer){0};
+}
+
+void json_writer_init(struct json_writer *writer, struct turtile_buffer *buffer,
+                      enum json_writer_format format) {
+    writer->buffer = buffer;
+    writer->format = format;
+    writer->depth = 0;
+    writer->count[0] = 0;
+    writer->after_key = false;
+}
+
+/**
+ * Appends a MessagePack type byte followed by an unsigned big endian value of
+ * |size| bytes.
+ */
+static void msgpack_put(struct turtile_buffer *buffer, uint8_t type,
+                        uint64_t value, int size) {
+    uint8_t bytes[9];
+
+    bytes[0] = type;
+    for (int i = 0; i < size; i++)
+        bytes[1 + i] = value >> (8 * (size - 1 - i));
+    buffer_append(buffer, bytes, 1 + size);
+}
+
+/**
+ * Writes the separator needed before a new value or key.
+ */
+static void json_writer_separate(struct json_writer *writer) {
+    if (writer->after_key) {
+        writer->after_key = false;
+        return;
+    }
+    if (writer->format == JSON_WRITER_TEXT && writer->count[writer->depth] > 0)
+        buffer_append(writer->buffer, ", ", 2);
+    writer->count[writer->depth]++;
+}
+
+static void json_writer_begin(struct json_writer *writer, char open,
+                              uint8_t msgpack_type) {
+    json_writer_separate(writer);
+    if (writer->depth == JSON_WRITER_MAX_DEPTH) {
+        writer->buffer->failed = true;
+        return;
+    }
+    writer->depth++;
+    writer->count[writer->depth] = 0;
+    writer->start[writer->depth] = writer->buffer->len;
+
+    if (writer->format == JSON_WRITER_MSGPACK)
+        msgpack_put(writer->buffer, msgpack_type, 0, 4);
+    else
+        buffer_append(writer->buffer, &open, 1);
+}
+
+static void json_writer_end(struct json_writer *writer, char close) {
+    struct turtile_buffer *buffer = writer->buffer;
+
+    if (writer->depth == 0 || buffer->failed)
+        return;
+
+    if (writer->format == JSON_WRITER_MSGPACK) {
+        // Fill in the number of entries left blank by json_writer_begin()
+        uint32_t count = writer->count[writer->depth];
+        uint8_t *size = (uint8_t *)buffer->data + writer->start[writer->depth] + 1;
+        for (int i = 0; i < 4; i++)
+            size[i] = count >> (8 * (3 - i));
+    } else {
+        buffer_append(buffer, &close, 1);
+    }
+    writer->depth--;
+}
+
+void json_writer_begin_object(struct json_writer *writer) {
+    json_writer_begin(writer, '{', 0xdf);
+}
+
+void json_writer_end_object(struct json_writer *writer) {
+    json_writer_end(writer, '}');
+}
+
+void json_writer_begin_array(struct json_writer *writer) {
+    json_writer_begin(writer, '[', 0xdd);
+}
+
+void json_writer_end_array(struct json_writer *writer) {
+    json_writer_end(writer, ']');
+}
+
+/**
+ * Writes a quoted and escaped string, without any separator.
+ */
+static void json_writer_quote(struct json_writer *writer, const char *value,
+                              size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    struct turtile_buffer *buffer = writer->buffer;
+
+    // Worst case every byte is escaped as \u00XX
+    if (!buffer_reserve(buffer, size * 6 + 2))
+        return;
+
+    char *out = buffer->data + buffer->len;
+    *out++ = '"';
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = value[i];
+        switch (c) {
+        case '"': *out++ = '\\'; *out++ = '"'; break;
+        case '\\': *out++ = '\\'; *out++ = '\\'; break;
+        case '\n': *out++ = '\\'; *out++ = 'n'; break;
+        case '\r': *out++ = '\\'; *out++ = 'r'; break;
+        case '\t': *out++ = '\\'; *out++ = 't'; break;
+        default:
+            if (c < 0x20) {
+                *out++ = '\\'; *out++ = 'u'; *out++ = '0'; *out++ = '0';
+                *out++ = hex[c >> 4]; *out++ = hex[c & 0xf];
+            } else {
+                *out++ = c;
+            }
+        }
+    }
+    *out++ = '"';
+    buffer->len = out - buffer->data;
+}
+
+/**
+ * Writes a string in the format of the writer, without any separator.
+ */
+static void json_writer_put_string(struct json_writer *writer,
+                                   const char *value, size_t size) {
+    if (writer->format == JSON_WRITER_TEXT) {
+        json_writer_quote(writer, value, size);
+        return;
+    }
+
+    if (size < 32)
+        msgpack_put(writer->buffer, 0xa0 | size, 0, 0);
+    else if (size <= UINT8_MAX)
+        msgpack_put(writer->buffer, 0xd9, size, 1);
+    else if (size <= UINT16_MAX)
+        msgpack_put(writer->buffer, 0xda, size, 2);
+    else
+        msgpack_put(writer->buffer, 0xdb, size, 4);
+    buffer_append(writer->buffer, value, size);
+}
+
+void json_writer_key(struct json_writer *writer, const char *key) {
+    json_writer_separate(writer);
+    json_writer_put_string(writer, key, strlen(key));
+    if (writer->format == JSON_WRITER_TEXT)
+        buffer_append(writer->buffer, ": ", 2);
+    writer->after_key = true;
+}
+
+void json_writer_string(struct json_writer *writer, const char *value) {
+    if (value == NULL) {
+        json_writer_null(writer);
+        return;
+    }
+    json_writer_separate(writer);
+    json_writer_put_string(writer, value, strlen(value));
+}
+
+void json_writer_vstringf(struct json_writer *writer, const char *format,
+                          va_list args) {
+    char small[256];
+    va_list copy;
+
+    va_copy(copy, args);
+    int size = vsnprintf(small, sizeof(small), format, copy);
+    va_end(copy);
+    if (size < 0) {
+        json_writer_null(writer);
+        return;
+    }
+
+    json_writer_separate(writer);
+    if ((size_t)size < sizeof(small)) {
+        json_writer_put_string(writer, small, size);
+        return;
+    }
+
+    // Rare long messages, typically carrying user provided arguments
+    char *large = malloc(size + 1);
+    if (!large) {
+        writer->buffer->failed = true;
+        return;
+    }
+    vsnprintf(large, size + 1, format, args);
+    json_writer_put_string(writer, large, size);
+    free(large);
+}
+
+void json_writer_stringf(struct json_writer *writer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    json_writer_vstringf(writer, format, args);
+    va_end(args);
+}
+
+/**
+ * Writes an integer in the smallest MessagePack representation.
+ */
+static void msgpack_put_int(struct turtile_buffer *buffer, int64_t value) {
+    if (value >= 0) {
+        if (value < 128)
+            msgpack_put(buffer, value, 0, 0);
+        else if (value <= UINT8_MAX)
+            msgpack_put(buffer, 0xcc, value, 1);
+        else if (value <= UINT16_MAX)
+            msgpack_put(buffer, 0xcd, value, 2);
+        else if (value <= UINT32_MAX)
+            msgpack_put(buffer, 0xce, value, 4);
+        else
+            msgpack_put(buffer, 0xcf, value, 8);
+    } else {
+        if (value >= -32)
+            msgpack_put(buffer, (uint8_t)value, 0, 0);
+        else if (value >= INT8_MIN)
+            msgpack_put(buffer, 0xd0, (uint8_t)value, 1);
+        else if (value >= INT16_MIN)
+            msgpack_put(buffer, 0xd1, (uint16_t)value, 2);
+        else if (value >= INT32_MIN)
+            msgpack_put(buffer, 0xd2, (uint32_t)value, 4);
+        else
+            msgpack_put(buffer, 0xd3, (uint64_t)value, 8);
+    }
+}
+
+void json_writer_int(struct json_writer *writer, int64_t value) {
+    json_writer_separate(writer);
+    if (writer->format == JSON_WRITER_MSGPACK) {
+        msgpack_put_int(writer->buffer, value);
+        return;
+    }
+
+    char number[24];
+    int size = snprintf(number, sizeof(number), "%" PRId64, value);
+    buffer_append(writer->buffer, number, size);
+}
+
+void json_writer_bool(struct json_writer *writer, bool value) {
+    json_writer_separate(writer);
+    if (writer->format == JSON_WRITER_MSGPACK)
+        msgpack_put(writer->buffer, value ? 0xc3 : 0xc2, 0, 0);
+    else if (value)
+        buffer_append(writer->buffer, "true", 4);
+    else
+        buffer_append(writer->buffer, "false", 5);
+}
+
+void json_writer_null(struct json_writer *writer) {
+    json_writer_separate(writer);
+    if (writer->format == JSON_WRITER_MSGPACK)
+        msgpack_put(writer->buffer, 0xc0, 0, 0);
+    else
+        buffer_append(writer->buffer, "null", 4);
+}
+
+void json_writer_raw(struct json_writer *writer, const char *json, size_t size) {
+    json_writer_separate(writer);
+    buffer_append(writer->buffer, json, size);
+}
@@ -0,0 +1,158 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_JSON_WRITER_H
+#define TURTILE_JSON_WRITER_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_WRITER_MAX_DEPTH 32 // max nesting of objects and arrays
+
+/**
+ * Encodings a json_writer can produce. Both describe the same JSON data
+ * model, MessagePack is a compact binary form of it that is cheaper to
+ * produce and to parse.
+ */
+enum json_writer_format {
+    JSON_WRITER_TEXT,
+    JSON_WRITER_MSGPACK,
+};
+
+#define JSON_WRITER_FORMATS 2 // number of json_writer_format values
+
+/**
+ * A growable byte buffer. It is meant to be reused: resetting it keeps the
+ * allocated memory, so once it has grown to fit the usual replies writing to
+ * it doesn't allocate anymore.
+ */
+struct turtile_buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed; // an allocation failed, the contents are incomplete
+};
+
+/**
+ * Streaming JSON serializer writing straight into a turtile_buffer, without
+ * building any intermediate tree. Commas and separators are added
+ * automatically, the caller only opens and closes containers and writes keys
+ * and values in order.
+ *
+ * In MessagePack format objects and arrays are always written as map 32 and
+ * array 32, their number of entries is filled in when they are closed.
+ */
+struct json_writer {
+    struct turtile_buffer *buffer;
+    enum json_writer_format format;
+    int depth;
+    // entries (values in arrays, keys in objects) written so far at depth
+    uint32_t count[JSON_WRITER_MAX_DEPTH + 1];
+    // offset of the MessagePack header of the container open at depth
+    size_t start[JSON_WRITER_MAX_DEPTH + 1];
+    bool after_key; // the next value belongs to the key just written
+};
+
+/**
+ * Makes sure the buffer can hold |size| more bytes.
+ *
+ * @param buffer The buffer to grow.
+ * @param size The number of bytes that are going to be appended.
+ * @return false if the memory could not be allocated.
+ */
+bool buffer_reserve(struct turtile_buffer *buffer, size_t size);
+
+/**
+ * Appends bytes at the end of the buffer.
+ *
+ * @param buffer The buffer to append to.
+ * @param data The bytes to append.
+ * @param size The number of bytes to append.
+ */
+void buffer_append(struct turtile_buffer *buffer, const void *data, size_t size);
+
+/**
+ * Frees the memory held by the buffer and leaves it empty.
+ *
+ * @param buffer The buffer to release.
+ */
+void buffer_finish(struct turtile_buffer *buffer);
+
+/**
+ * Starts writing a JSON document at the end of the buffer.
+ *
+ * @param writer The writer to initialize.
+ * @param buffer The buffer the document is appended to.
+ * @param format The encoding of the document.
+ */
+void json_writer_init(struct json_writer *writer, struct turtile_buffer *buffer,
+                      enum json_writer_format format);
+
+void json_writer_begin_object(struct json_writer *writer);
+void json_writer_end_object(struct json_writer *writer);
+void json_writer_begin_array(struct json_writer *writer);
+void json_writer_end_array(struct json_writer *writer);
+
+/**
+ * Writes the key of the next member of the current object.
+ *
+ * @param writer The writer.
+ * @param key The key, escaped as needed.
+ */
+void json_writer_key(struct json_writer *writer, const char *key);
+
+/**
+ * Writes a string value, escaping it as needed. NULL is written as null.
+ *
+ * @param writer The writer.
+ * @param value The string to write.
+ */
+void json_writer_string(struct json_writer *writer, const char *value);
+
+/**
+ * Writes a string value built from a printf style format.
+ *
+ * @param writer The writer.
+ * @param format The printf style format of the string.
+ */
+void json_writer_stringf(struct json_writer *writer, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void json_writer_vstringf(struct json_writer *writer, const char *format,
+                          va_list args);
+
+void json_writer_int(struct json_writer *writer, int64_t value);
+void json_writer_bool(struct json_writer *writer, bool value);
+void json_writer_null(struct json_writer *writer);
+
+/**
+ * Writes an already serialized value as is. It must be encoded in the format
+ * of the writer.
+ *
+ * @param writer The writer.
+ * @param json The serialized value.
+ * @param size The size of the serialized value in bytes.
+ */
+void json_writer_raw(struct json_writer *writer, const char *json, size_t size);
+
+#endif // TURTILE_JSON_WRITER_H
@@ -21,15 +21,99 @@
 */
 
 #include "keyboard.h"
+#include "commands.h"
 #include "config.h"
 #include "toplevel.h"
 
 #include "wlr/util/log.h"
 #include <stdlib.h>
-#include <unistd.h>
+#include <string.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xdg_shell.h>
 
+/**
+ * A keymap compiled for some RMLVO names, shared by every keyboard using
+ * them so that plugging a device in does not compile it again.
+ */
+struct turtile_keymap {
+    struct wl_list link;
+    char *rules, *model, *layout, *variant, *options;
+    struct xkb_keymap *keymap;
+};
+
+static struct xkb_context *xkb_context; // shared by every keymap
+static struct wl_list keymaps = {&keymaps, &keymaps}; // turtile_keymap.link
+
+static bool names_equal(const char *a, const char *b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static char *name_dup(const char *name) {
+    return name ? strdup(name) : NULL;
+}
+
+static void keymap_destroy(struct turtile_keymap *keymap) {
+    wl_list_remove(&keymap->link);
+    xkb_keymap_unref(keymap->keymap);
+    free(keymap->rules);
+    free(keymap->model);
+    free(keymap->layout);
+    free(keymap->variant);
+    free(keymap->options);
+    free(keymap);
+}
+
+/**
+ * Returns the keymap of the keyboard config, compiling it the first time.
+ *
+ * @return The keymap, owned by the cache, or NULL if it does not compile.
+ */
+static struct xkb_keymap *keymap_get(const turtile_keyboard_config_t *config) {
+    struct turtile_keymap *keymap;
+    wl_list_for_each(keymap, &keymaps, link) {
+        if (names_equal(keymap->rules, config->rules) &&
+            names_equal(keymap->model, config->model) &&
+            names_equal(keymap->layout, config->layout) &&
+            names_equal(keymap->variant, config->variant) &&
+            names_equal(keymap->options, config->options))
+            return keymap->keymap;
+    }
+
+    if (!xkb_context && !(xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS))) {
+        wlr_log(WLR_ERROR, "Failed to create the xkb context");
+        return NULL;
+    }
+    const struct xkb_rule_names names = {
+        .rules = config->rules,
+        .model = config->model,
+        .layout = config->layout,
+        .variant = config->variant,
+        .options = config->options,
+    };
+    struct xkb_keymap *xkb_keymap = xkb_keymap_new_from_names(xkb_context,
+        &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!xkb_keymap) {
+        wlr_log(WLR_ERROR, "Failed to compile the keymap of layout %s",
+                config->layout ? config->layout : "(default)");
+        return NULL;
+    }
+
+    keymap = calloc(1, sizeof(*keymap));
+    if (!keymap) {
+        wlr_log(WLR_ERROR, "Failed to allocate keymap");
+        xkb_keymap_unref(xkb_keymap);
+        return NULL;
+    }
+    keymap->keymap = xkb_keymap;
+    keymap->rules = name_dup(config->rules);
+    keymap->model = name_dup(config->model);
+    keymap->layout = name_dup(config->layout);
+    keymap->variant = name_dup(config->variant);
+    keymap->options = name_dup(config->options);
+    wl_list_insert(&keymaps, &keymap->link);
+    return xkb_keymap;
+}
+
 void keyboard_handle_modifiers(
         struct wl_listener *listener, void *data) {
     /* This event is raised when a modifier key, such as shift or alt, is
@@ -48,21 +132,62 @@ void keyboard_handle_modifiers(
         &keyboard->wlr_keyboard->modifiers);
 }
 
+/**
+ * Returns the keybinds the next key press is matched against.
+ */
+static turtile_keybind_map_t *current_keybinds(struct turtile_server *server) {
+	if (server->keybind_chord)
+		return server->keybind_chord;
+	if (server->keybind_mode)
+		return server->keybind_mode;
+	return &config_get_instance()->keybinds;
+}
+
+/**
+ * Checks whether a keysym is the one of a modifier key, pressed on the way to
+ * the next key of a chord.
+ */
+static bool keysym_is_modifier(xkb_keysym_t sym) {
+	return (sym >= XKB_KEY_Shift_L && sym <= XKB_KEY_Hyper_R) ||
+		(sym >= XKB_KEY_ISO_Lock && sym <= XKB_KEY_ISO_Level5_Lock) ||
+		sym == XKB_KEY_Mode_switch || sym == XKB_KEY_Num_Lock;
+}
+
 bool handle_keybinding(struct turtile_server *server, uint32_t modifiers,
 					   xkb_keysym_t sym) {
-    turtile_keybind_t *keybind;
-	/* wlr_log(WLR_INFO, "key event: %d %d", modifiers, sym); */
-	wl_list_for_each(keybind, &config_get_instance()->keybinds, link) {
-		// Check if both the key and the modifiers match
-		/* wlr_log(WLR_INFO, "keybind: %d %d", keybind->mods, keybind->key); */
-		if ((keybind->mods == modifiers) && (keybind->key == sym)) {
-			wlr_log(WLR_INFO, "Executing command: %s", keybind->cmd);
-			if (fork() == 0)
-				execl("/bin/sh", "/bin/sh", "-c", keybind->cmd, (void *)NULL);
-			return true;
-		}
+    turtile_keybind_t *keybind =
+		config_find_keybind(current_keybinds(server), modifiers, sym);
+	if (!keybind) {
+		if (!server->keybind_chord || keysym_is_modifier(sym))
+			return false;
+		// Any other key cancels the chord, without reaching the client
+		wlr_log(WLR_DEBUG, "Chord cancelled");
+		server->keybind_chord = NULL;
+		return true;
+	}
+
+	// Each key press is one transition of the keyboard state
+	if (keybind->then) {
+		server->keybind_chord = keybind->then;
+		return true;
 	}
-	return false;
+	server->keybind_chord = NULL;
+	if (keybind->mode) {
+		wlr_log(WLR_DEBUG, "Entering mode %s", keybind->mode_name);
+		server->keybind_mode = keybind->mode;
+	}
+	if (!keybind->cmd)
+		return true;
+
+	if (keybind->internal) {
+		// Runs right away, without a shell or a trip through the socket
+		wlr_log(WLR_DEBUG, "Running command: %s", keybind->cmd);
+		execute_internal_command(server, keybind->cmd);
+	} else {
+		wlr_log(WLR_INFO, "Executing command: %s", keybind->cmd);
+		spawn_command(server->spawner, keybind->cmd, server->active_workspace);
+	}
+	return true;
 }
 
 void keyboard_handle_key(
@@ -74,18 +199,21 @@ void keyboard_handle_key(
     struct wlr_keyboard_key_event *event = data;
     struct wlr_seat *seat = server->seat;
 
-    /* Translate libinput keycode -> xkbcommon */
-    uint32_t keycode = event->keycode + 8;
-    /* Get a list of keysyms based on the keymap for this keyboard */
-    const xkb_keysym_t *syms;
-    int nsyms = xkb_state_key_get_syms(
-            keyboard->wlr_keyboard->xkb_state, keycode, &syms);
-
     bool handled = false;
     uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard->wlr_keyboard);
-    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-        /* On _pressed_ we attempt to process a compositor keybinding. */
-        for (int i = 0; i < nsyms; i++) {
+    /* On _pressed_ we attempt to process a compositor keybinding, unless no
+     * keybind uses these modifiers, which is the case of most key presses.
+     * Halfway through a chord every key counts, as the others cancel it. */
+    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED &&
+            (server->keybind_chord ||
+             config_keybind_mods_bound(current_keybinds(server), modifiers))) {
+        /* Translate libinput keycode -> xkbcommon */
+        uint32_t keycode = event->keycode + 8;
+        /* Get a list of keysyms based on the keymap for this keyboard */
+        const xkb_keysym_t *syms;
+        int nsyms = xkb_state_key_get_syms(
+                keyboard->wlr_keyboard->xkb_state, keycode, &syms);
+        for (int i = 0; i < nsyms && !handled; i++) {
             handled = handle_keybinding(server, modifiers, syms[i]);
         }
     }
@@ -120,16 +248,15 @@ void server_new_keyboard(struct turtile_server *server,
     keyboard->server = server;
     keyboard->wlr_keyboard = wlr_keyboard;
 
-    /* We need to prepare an XKB keymap and assign it to the keyboard. This
-     * assumes the defaults (e.g. layout = "us"). */
-    struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    struct xkb_keymap *keymap = xkb_keymap_new_from_names(context, NULL,
-        XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-    wlr_keyboard_set_keymap(wlr_keyboard, keymap);
-    xkb_keymap_unref(keymap);
-    xkb_context_unref(context);
-    wlr_keyboard_set_repeat_info(wlr_keyboard, 25, 600);
+    /* We need to prepare an XKB keymap and assign it to the keyboard. Its
+     * names come from the config, or are the defaults (e.g. layout = "us").
+     * Keyboards with the same names share one compiled keymap. */
+    turtile_keyboard_config_t *config = &config_get_instance()->keyboard;
+    struct xkb_keymap *keymap = keymap_get(config);
+    if (keymap)
+        wlr_keyboard_set_keymap(wlr_keyboard, keymap);
+    wlr_keyboard_set_repeat_info(wlr_keyboard, config->repeat_rate,
+                                 config->repeat_delay);
 
     /* Here we set up listeners for keyboard events. */
     keyboard->modifiers.notify = keyboard_handle_modifiers;
@@ -144,3 +271,26 @@ void server_new_keyboard(struct turtile_server *server,
     /* And add the keyboard to our list of keyboards */
     wl_list_insert(&server->keyboards, &keyboard->link);
 }
+
+void keyboard_apply_config(struct turtile_server *server, bool keymap_changed) {
+    turtile_keyboard_config_t *config = &config_get_instance()->keyboard;
+    struct xkb_keymap *keymap = keymap_changed ? keymap_get(config) : NULL;
+
+    struct turtile_keyboard *keyboard;
+    wl_list_for_each(keyboard, &server->keyboards, link) {
+        if (keymap)
+            wlr_keyboard_set_keymap(keyboard->wlr_keyboard, keymap);
+        wlr_keyboard_set_repeat_info(keyboard->wlr_keyboard, config->repeat_rate,
+                                     config->repeat_delay);
+    }
+}
+
+void keyboard_finish(void) {
+    while (!wl_list_empty(&keymaps)) {
+        struct turtile_keymap *keymap =
+            wl_container_of(keymaps.next, keymap, link);
+        keymap_destroy(keymap);
+    }
+    xkb_context_unref(xkb_context);
+    xkb_context = NULL;
+}
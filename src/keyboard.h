@@ -92,4 +92,19 @@ void keyboard_handle_destroy(struct wl_listener *listener, void *data);
  */
 void server_new_keyboard(struct turtile_server *server,
                                 struct wlr_input_device *device);
+
+/**
+ * Applies the keyboard settings of the config to every keyboard, after the
+ * config was reloaded.
+ *
+ * @param server - The turtile_server structure representing the compositor.
+ * @param keymap_changed - Whether the keymap names changed.
+ */
+void keyboard_apply_config(struct turtile_server *server, bool keymap_changed);
+
+/**
+ * Releases the xkb context and the keymaps shared by the keyboards. Must be
+ * called once at exit, after the keyboards are destroyed.
+ */
+void keyboard_finish(void);
 #endif // TURTILE_KEYBOARD_H
@@ -25,7 +25,12 @@
 #include "output.h"
 #include "cursor.h"
 #include "src/commands.h"
+#include "src/events.h"
+#include "src/reload.h"
+#include "src/scheduler.h"
+#include "src/snapshot.h"
 #include "src/socket_server.h"
+#include "src/spawner.h"
 #include "src/workspace.h"
 #include "toplevel.h"
 #include "popup.h"
@@ -35,7 +40,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <pthread.h>
 #include <wlr/backend.h>
 #include <wlr/backend/headless.h>
 #include <wlr/render/allocator.h>
@@ -147,13 +151,13 @@ int main(int argc, char *argv[]) {
 
     // Set a static background color
 	float *color = config_get_instance()->backgroundColor;
-    struct wlr_scene_rect *background =
+    server.background =
 		wlr_scene_rect_create(&server.scene->tree, 10000, 10000, color);
-    if (!background) {
+    if (!server.background) {
         wlr_log(WLR_ERROR, "Failed to create background color rectangle");
         return 1;
     }
-    wlr_scene_node_raise_to_top(&background->node);
+    wlr_scene_node_raise_to_top(&server.background->node);
 
     /* Set up xdg-shell version 3. The xdg-shell is a Wayland protocol which is
      * used for application windows. For more detail on shells, refer to
@@ -241,29 +245,60 @@ int main(int argc, char *argv[]) {
     /* Set the WAYLAND_DISPLAY environment variable to our socket and run the
      * startup command if requested. */
     setenv("WAYLAND_DISPLAY", socket, true);
+    server.spawner = spawner_create(wl_display_get_event_loop(server.wl_display));
+    if (!server.spawner) {
+        wlr_backend_destroy(server.backend);
+        wl_display_destroy(server.wl_display);
+        return 1;
+    }
     if (startup_cmd) {
-        if (fork() == 0) {
-            execl("/bin/sh", "/bin/sh", "-c", startup_cmd, (void *)NULL);
-        }
+        spawn_command(server.spawner, startup_cmd, server.active_workspace);
     }
 
-	// Run autostart commands from config
-	turtile_autostart_t *autostart;
-    wl_list_for_each(autostart, &config_get_instance()->autostart, link) {
+	// Run autostart commands from config, turtile commands need the table
+	// of commands
+	commands_init();
+	turtile_config_t *config = config_get_instance();
+    // Last entry first, as they always ran
+    for (size_t i = config->autostart_count; i-- > 0;) {
+        turtile_autostart_t *autostart = &config->autostart[i];
         wlr_log(WLR_INFO, "Executing command: %s", autostart->cmd);
-        if (fork() == 0)
-			execl("/bin/sh", "/bin/sh", "-c", autostart->cmd, (void *)NULL);
+        if (autostart->internal) {
+            execute_internal_command(&server, autostart->cmd);
+            // A config reload freed the rest of the entries
+            if (config_get_instance() != config)
+                break;
+        } else {
+            struct turtile_workspace *workspace = server.active_workspace;
+            if (autostart->workspace &&
+                !(workspace = get_workspace(&server, autostart->workspace))) {
+                wlr_log(WLR_ERROR, "Workspace %s of %s not found",
+                        autostart->workspace, autostart->cmd);
+                workspace = server.active_workspace;
+            }
+            spawn_command(server.spawner, autostart->cmd, workspace);
+        }
     }
 
-	// Create context for the commands
-	struct turtile_context context;
-	context.server = &server;
-
-    // Create a thread for the socket server
-    pthread_t server_thread;
-    if (pthread_create(&server_thread, NULL, start_socket_server, &context) != 0) {
-        perror("Failed to create server thread");
-        return EXIT_FAILURE;
+    /* Serve IPC clients from the Wayland event loop, so that commands are
+     * executed on the same thread that owns the compositor state. Requests
+     * run from the scheduler, after the input and frames of each iteration
+     * of the loop. */
+    server.scheduler = scheduler_create(
+        wl_display_get_event_loop(server.wl_display));
+    if (!server.scheduler) {
+        wlr_backend_destroy(server.backend);
+        wl_display_destroy(server.wl_display);
+        return 1;
+    }
+    events_init(&server);
+    workspaces_init(&server);
+    config_watch_update(&server);
+    server.socket_server = socket_server_create(&server);
+    if (!server.socket_server) {
+        wlr_backend_destroy(server.backend);
+        wl_display_destroy(server.wl_display);
+        return 1;
     }
 
     /* Run the Wayland event loop. This does not return until you exit the
@@ -276,15 +311,25 @@ int main(int argc, char *argv[]) {
     wl_display_run(server.wl_display);
 
     /* Once wl_display_run returns, we destroy all clients then shut down the
-     * server. */
-	config_free_instance();
+     * server. Unmapping their windows still sends events to subscribers. */
+	if (server.config_watch)
+		config_watch_destroy(server.config_watch);
     wl_display_destroy_clients(server.wl_display);
+	socket_server_destroy(server.socket_server);
+	server.socket_server = NULL;
+	snapshot_destroy(server.snapshot);
+	server.snapshot = NULL;
+	commands_finish();
+	config_free_instance();
     wlr_scene_node_destroy(&server.scene->tree.node);
     wlr_xcursor_manager_destroy(server.cursor_mgr);
 	wlr_cursor_destroy(server.cursor);
 	wlr_allocator_destroy(server.allocator);
 	wlr_renderer_destroy(server.renderer);
 	wlr_backend_destroy(server.backend);
+	keyboard_finish();
+	spawner_destroy(server.spawner);
+	scheduler_destroy(server.scheduler);
     wl_display_destroy(server.wl_display);
     return 0;
 }
@@ -21,6 +21,7 @@
 */
 
 #include "output.h"
+#include "socket_server.h"
 #include <stdlib.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
@@ -36,13 +37,21 @@ void output_frame(struct wl_listener *listener, void *data) {
         scene, output->wlr_output);
 
     /* Render the scene if needed and commit the output */
-    wlr_scene_output_commit(scene_output, NULL);
+    if (wlr_scene_output_commit(scene_output, NULL))
+        socket_server_notify_frame(output->server->socket_server);
 
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
     wlr_scene_output_send_frame_done(scene_output, &now);
 }
 
+void output_schedule_frames(struct turtile_server *server) {
+    struct turtile_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        wlr_output_schedule_frame(output->wlr_output);
+    }
+}
+
 void output_request_state(struct wl_listener *listener, void *data) {
     /* This function is called when the backend requests a new state for
      * the output. For example, Wayland and X11 backends request a new mode
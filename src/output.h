@@ -49,6 +49,14 @@ struct turtile_output {
  */
 void output_frame(struct wl_listener *listener, void *data);
 
+/**
+ * Ask every output for a new frame, even if nothing has been damaged, so
+ * that IPC clients waiting for the next frame get it.
+ *
+ * @param server - The server whose outputs must render a frame.
+ */
+void output_schedule_frames(struct turtile_server *server);
+
 /**
  * This function is called when the backend requests a new state for the
  * output. For example, Wayland and X11 backends request a new mode when the
@@ -0,0 +1,254 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "reload.h"
+#include "src/config.h"
+#include "src/keyboard.h"
+#include "src/server.h"
+#include "src/snapshot.h"
+#include "src/toplevel.h"
+#include "src/workspace.h"
+#include "wlr/util/log.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <wlr/types/wlr_scene.h>
+
+static bool string_equal(const char *a, const char *b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static bool keymap_changed(const turtile_keyboard_config_t *old,
+                           const turtile_keyboard_config_t *new) {
+    return !string_equal(old->rules, new->rules) ||
+        !string_equal(old->model, new->model) ||
+        !string_equal(old->layout, new->layout) ||
+        !string_equal(old->variant, new->variant) ||
+        !string_equal(old->options, new->options);
+}
+
+/**
+ * Checks whether the workspaces of the server start with those of the
+ * config, in the same order.
+ */
+static bool workspaces_in_order(struct turtile_server *server,
+                                turtile_config_t *config) {
+    struct wl_list *link = server->workspaces.next;
+
+    for (size_t i = 0; i < config->workspace_count; i++) {
+        if (link == &server->workspaces)
+            return false;
+        struct turtile_workspace *workspace =
+            wl_container_of(link, workspace, link);
+        if (strcmp(workspace->name, config->workspaces[i].name) != 0)
+            return false;
+        link = link->next;
+    }
+    return true;
+}
+
+static bool workspace_configured(turtile_config_t *config, const char *name) {
+    for (size_t i = 0; i < config->workspace_count; i++) {
+        if (strcmp(config->workspaces[i].name, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Adds the new workspaces of the config and removes those it lost, leaving
+ * the others and their windows alone.
+ *
+ * @return true if the workspaces changed.
+ */
+static bool reload_workspaces(struct turtile_server *server,
+                              turtile_config_t *config) {
+    bool changed = !workspaces_in_order(server, config);
+
+    // Moving each one to the head in reverse order puts them in file order
+    for (size_t i = config->workspace_count; i-- > 0;) {
+        turtile_workspace_config_t *workspace_config = &config->workspaces[i];
+        struct turtile_workspace *workspace =
+            get_workspace(server, workspace_config->name);
+        if (!workspace) {
+            create_workspace(server, workspace_config->name);
+            continue;
+        }
+        workspace->removed = false;
+        wl_list_remove(&workspace->link);
+        wl_list_insert(&server->workspaces, &workspace->link);
+    }
+
+    struct turtile_workspace *workspace, *tmp;
+    wl_list_for_each_safe(workspace, tmp, &server->workspaces, link) {
+        if (workspace_configured(config, workspace->name))
+            continue;
+        if (workspace == server->active_workspace ||
+            workspace_has_windows(workspace)) {
+            wlr_log(WLR_INFO, "Keeping workspace %s until it is left empty",
+                    workspace->name);
+            workspace->removed = true;
+            continue;
+        }
+        destroy_workspace(workspace);
+        changed = true;
+    }
+    return changed;
+}
+
+bool config_reload(struct turtile_server *server, char *error, size_t size) {
+    turtile_config_t *old = config_get_instance();
+    if (!old || !old->path) {
+        snprintf(error, size, "no config file was loaded");
+        return false;
+    }
+    turtile_config_t *config = config_parse(old->path, error, size);
+    if (!config)
+        return false;
+
+    // Nothing may point into the old config once it is released: stay in the
+    // current mode if it still exists, and drop any chord halfway through
+    const char *mode_name = NULL;
+    for (size_t i = 0; i < old->mode_count; i++) {
+        if (&old->modes[i].keybinds == server->keybind_mode)
+            mode_name = old->modes[i].name;
+    }
+    server->keybind_mode = mode_name ? config_find_mode(config, mode_name) : NULL;
+    server->keybind_chord = NULL;
+
+    bool new_keymap = keymap_changed(&old->keyboard, &config->keyboard);
+    bool new_repeat = old->keyboard.repeat_rate != config->keyboard.repeat_rate ||
+        old->keyboard.repeat_delay != config->keyboard.repeat_delay;
+    bool new_background = memcmp(old->backgroundColor, config->backgroundColor,
+                                 sizeof(old->backgroundColor)) != 0;
+    config_swap_instance(config);
+
+    if (reload_workspaces(server, config)) {
+        server_bump_generation(server);
+        snapshot_update(server);
+    }
+    if (new_background)
+        wlr_scene_rect_set_color(server->background, config->backgroundColor);
+    if (new_keymap || new_repeat)
+        keyboard_apply_config(server, new_keymap);
+
+    config_release(old);
+    config_watch_update(server);
+    wlr_log(WLR_INFO, "Reloaded config from %s", config->path);
+    return true;
+}
+
+static void handle_reload_task(struct turtile_task *task,
+                               const struct timespec *deadline) {
+    struct turtile_config_watch *watch = wl_container_of(task, watch, task);
+    char error[256];
+
+    // May destroy the watch, if the new config stops watching
+    if (!config_reload(watch->server, error, sizeof(error)))
+        wlr_log(WLR_ERROR, "Failed to reload the config: %s", error);
+}
+
+static int handle_inotify(int fd, uint32_t mask, void *data) {
+    struct turtile_config_watch *watch = data;
+    char buffer[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t size;
+
+    // A save is often several events, they all end up in one reload run
+    // after the input and frames of this iteration
+    while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + size;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (event->len && strcmp(event->name, watch->name) == 0)
+                scheduler_add(watch->server->scheduler, &watch->task);
+            p += sizeof(*event) + event->len;
+        }
+    }
+    if (size == -1 && errno != EAGAIN)
+        wlr_log_errno(WLR_ERROR, "Failed to read the config watch");
+    return 0;
+}
+
+static struct turtile_config_watch *config_watch_create(
+        struct turtile_server *server, const char *path) {
+    struct turtile_config_watch *watch = calloc(1, sizeof(*watch));
+    if (!watch) {
+        wlr_log(WLR_ERROR, "Failed to allocate the config watch");
+        return NULL;
+    }
+    watch->server = server;
+    turtile_task_init(&watch->task, TASK_PRIORITY_HOUSEKEEPING,
+                      handle_reload_task);
+
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+    watch->name = strdup(slash + 1);
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (!watch->name || watch->fd == -1 ||
+        inotify_add_watch(watch->fd, dir[0] ? dir : "/",
+                          IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        wlr_log_errno(WLR_ERROR, "Failed to watch %s", path);
+        goto error;
+    }
+
+    struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+    watch->source = wl_event_loop_add_fd(loop, watch->fd, WL_EVENT_READABLE,
+                                         handle_inotify, watch);
+    if (!watch->source) {
+        wlr_log(WLR_ERROR, "Failed to add the config watch to the event loop");
+        goto error;
+    }
+    wlr_log(WLR_INFO, "Reloading %s when it changes", path);
+    return watch;
+
+error:
+    if (watch->fd != -1)
+        close(watch->fd);
+    free(watch->name);
+    free(watch);
+    return NULL;
+}
+
+void config_watch_destroy(struct turtile_config_watch *watch) {
+    scheduler_cancel(&watch->task);
+    wl_event_source_remove(watch->source);
+    close(watch->fd);
+    free(watch->name);
+    free(watch);
+}
+
+void config_watch_update(struct turtile_server *server) {
+    turtile_config_t *config = config_get_instance();
+    bool watch = config && config->path && config->reload_on_change;
+
+    if (watch && !server->config_watch) {
+        server->config_watch = config_watch_create(server, config->path);
+    } else if (!watch && server->config_watch) {
+        config_watch_destroy(server->config_watch);
+        server->config_watch = NULL;
+    }
+}
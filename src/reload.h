@@ -0,0 +1,73 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_RELOAD_H
+#define TURTILE_RELOAD_H
+
+#include "scheduler.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <wayland-server-core.h>
+
+struct turtile_server;
+
+/**
+ * Watches the directory of the config file, as editors often replace the file
+ * rather than write to it, and reloads the config once it was written.
+ */
+struct turtile_config_watch {
+    struct turtile_server *server;
+    int fd; // inotify
+    struct wl_event_source *source;
+    struct turtile_task task; // reloads once the pending events are read
+    char *name; // name of the config file in the watched directory
+};
+
+/**
+ * Reads the config file again and applies only what changed: the keybinds,
+ * the workspaces, the background and the keyboard settings. Workspaces gone
+ * from the file are removed unless they still hold windows or are active.
+ * Autostart entries are not run again.
+ *
+ * @param server The server.
+ * @param error Filled with the reason of a failure.
+ * @param size The size of |error|.
+ * @return true if the config was reloaded, false if it is left unchanged.
+ */
+bool config_reload(struct turtile_server *server, char *error, size_t size);
+
+/**
+ * Starts or stops watching the config file, following the reload_on_change
+ * setting of the current config.
+ *
+ * @param server The server.
+ */
+void config_watch_update(struct turtile_server *server);
+
+/**
+ * Stops watching the config file.
+ *
+ * @param watch The watch to destroy.
+ */
+void config_watch_destroy(struct turtile_config_watch *watch);
+
+#endif // TURTILE_RELOAD_H
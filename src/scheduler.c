@@ -0,0 +1,181 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "scheduler.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "wlr/util/log.h"
+
+static void scheduler_run(void *data);
+
+/**
+ * Runs the scheduler once the event loop has dispatched the current events.
+ */
+static void scheduler_wake(struct turtile_scheduler *scheduler) {
+    if (!scheduler->idle && !scheduler->running)
+        scheduler->idle = wl_event_loop_add_idle(scheduler->loop,
+                                                 scheduler_run, scheduler);
+}
+
+static int handle_wakeup(int fd, uint32_t mask, void *data) {
+    struct turtile_scheduler *scheduler = data;
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        wlr_log_errno(WLR_ERROR, "Failed to read the scheduler eventfd");
+    scheduler_wake(scheduler);
+    return 0;
+}
+
+static void task_dequeue(struct turtile_task *task) {
+    wl_list_remove(&task->link);
+    wl_list_init(&task->link);
+    task->scheduled = false;
+}
+
+static void scheduler_run(void *data) {
+    struct turtile_scheduler *scheduler = data;
+    struct turtile_task *task;
+    struct timespec deadline;
+
+    scheduler->idle = NULL;
+    scheduler->running = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += SCHEDULER_IPC_BUDGET_US * 1000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    // A task with more work goes back to the end of the queue, so clients
+    // take turns instead of the busiest one holding the budget
+    struct wl_list *queue = &scheduler->queues[TASK_PRIORITY_IPC];
+    while (!wl_list_empty(queue) && !task_deadline_passed(&deadline)) {
+        task = wl_container_of(queue->next, task, link);
+        task_dequeue(task);
+        task->run(task, &deadline);
+    }
+
+    // Only what was queued before, tasks scheduled by these run next time
+    struct wl_list housekeeping;
+    queue = &scheduler->queues[TASK_PRIORITY_HOUSEKEEPING];
+    wl_list_init(&housekeeping);
+    wl_list_insert_list(&housekeeping, queue);
+    wl_list_init(queue);
+    while (!wl_list_empty(&housekeeping)) {
+        task = wl_container_of(housekeeping.next, task, link);
+        task_dequeue(task);
+        task->run(task, NULL);
+    }
+
+    scheduler->running = false;
+
+    // Come back after the events that arrived in the meantime
+    for (int i = 0; i < TASK_PRIORITIES; i++) {
+        if (!wl_list_empty(&scheduler->queues[i])) {
+            uint64_t one = 1;
+            if (write(scheduler->wakeup_fd, &one, sizeof(one)) == -1)
+                wlr_log_errno(WLR_ERROR, "Failed to wake the scheduler up");
+            break;
+        }
+    }
+}
+
+struct turtile_scheduler *scheduler_create(struct wl_event_loop *loop) {
+    struct turtile_scheduler *scheduler = calloc(1, sizeof(*scheduler));
+    if (!scheduler) {
+        wlr_log(WLR_ERROR, "Failed to allocate the scheduler");
+        return NULL;
+    }
+    scheduler->loop = loop;
+    for (int i = 0; i < TASK_PRIORITIES; i++)
+        wl_list_init(&scheduler->queues[i]);
+
+    scheduler->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (scheduler->wakeup_fd == -1) {
+        wlr_log_errno(WLR_ERROR, "Failed to create the scheduler eventfd");
+        free(scheduler);
+        return NULL;
+    }
+    scheduler->wakeup = wl_event_loop_add_fd(loop, scheduler->wakeup_fd,
+                                             WL_EVENT_READABLE, handle_wakeup,
+                                             scheduler);
+    if (!scheduler->wakeup) {
+        wlr_log(WLR_ERROR, "Failed to watch the scheduler eventfd");
+        close(scheduler->wakeup_fd);
+        free(scheduler);
+        return NULL;
+    }
+    return scheduler;
+}
+
+void scheduler_destroy(struct turtile_scheduler *scheduler) {
+    for (int i = 0; i < TASK_PRIORITIES; i++) {
+        while (!wl_list_empty(&scheduler->queues[i])) {
+            struct turtile_task *task =
+                wl_container_of(scheduler->queues[i].next, task, link);
+            task_dequeue(task);
+        }
+    }
+    if (scheduler->idle)
+        wl_event_source_remove(scheduler->idle);
+    wl_event_source_remove(scheduler->wakeup);
+    close(scheduler->wakeup_fd);
+    free(scheduler);
+}
+
+void turtile_task_init(struct turtile_task *task,
+                       enum turtile_task_priority priority,
+                       turtile_task_func_t run) {
+    wl_list_init(&task->link);
+    task->priority = priority;
+    task->run = run;
+    task->scheduled = false;
+}
+
+void scheduler_add(struct turtile_scheduler *scheduler,
+                   struct turtile_task *task) {
+    if (task->scheduled)
+        return;
+    wl_list_insert(scheduler->queues[task->priority].prev, &task->link);
+    task->scheduled = true;
+    scheduler_wake(scheduler);
+}
+
+void scheduler_cancel(struct turtile_task *task) {
+    if (task->scheduled)
+        task_dequeue(task);
+}
+
+bool task_deadline_passed(const struct timespec *deadline) {
+    if (!deadline)
+        return false;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec ||
+        (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
@@ -0,0 +1,137 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_SCHEDULER_H
+#define TURTILE_SCHEDULER_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+// Time IPC work may take in one iteration of the event loop, a small part of
+// a frame so a burst of requests never makes the compositor miss one
+#define SCHEDULER_IPC_BUDGET_US 2000
+
+/**
+ * Priority classes of deferred work, from the most urgent. Input and frame
+ * events come first: they are handled by their own event sources as soon as
+ * the event loop sees them, and scheduled work only runs once every event of
+ * the iteration has been dispatched.
+ */
+enum turtile_task_priority {
+    // IPC requests, run in turns until the budget of the iteration is spent
+    TASK_PRIORITY_IPC,
+    // bookkeeping such as coalesced events, run once IPC had its turn
+    TASK_PRIORITY_HOUSEKEEPING,
+};
+
+#define TASK_PRIORITIES 2 // number of turtile_task_priority values
+
+struct turtile_task;
+
+/**
+ * Runs a task. A task that has more work than it can do before |deadline|
+ * adds itself back with scheduler_add().
+ *
+ * @param task The task.
+ * @param deadline When the task should stop, NULL if it has no limit.
+ */
+typedef void (*turtile_task_func_t)(struct turtile_task *task,
+                                    const struct timespec *deadline);
+
+/**
+ * A unit of deferred work, meant to be embedded in the object it works on.
+ */
+struct turtile_task {
+    struct wl_list link; // in the queue of its priority while scheduled
+    enum turtile_task_priority priority;
+    turtile_task_func_t run;
+    bool scheduled;
+};
+
+/**
+ * Runs deferred work on the main event loop after the events of each
+ * iteration, by priority. When the IPC budget runs out the remaining work is
+ * left for the next iteration, so input and frames that arrived meanwhile are
+ * handled first.
+ */
+struct turtile_scheduler {
+    struct wl_event_loop *loop;
+    struct wl_list queues[TASK_PRIORITIES];
+    struct wl_event_source *idle; // run pending after the current events
+    int wakeup_fd; // eventfd readable while work is left for the next iteration
+    struct wl_event_source *wakeup;
+    bool running;
+};
+
+/**
+ * Creates the scheduler of an event loop.
+ *
+ * @param loop The event loop running the tasks.
+ * @return The scheduler, or NULL on failure.
+ */
+struct turtile_scheduler *scheduler_create(struct wl_event_loop *loop);
+
+/**
+ * Destroys the scheduler. Tasks still scheduled are dropped without running.
+ *
+ * @param scheduler The scheduler to destroy.
+ */
+void scheduler_destroy(struct turtile_scheduler *scheduler);
+
+/**
+ * Initializes a task that is not scheduled.
+ *
+ * @param task The task.
+ * @param priority The priority class of the task.
+ * @param run Called when the task runs.
+ */
+void turtile_task_init(struct turtile_task *task,
+                       enum turtile_task_priority priority,
+                       turtile_task_func_t run);
+
+/**
+ * Schedules a task at the end of the queue of its priority. Does nothing if
+ * the task is already scheduled.
+ *
+ * @param scheduler The scheduler.
+ * @param task The task to schedule.
+ */
+void scheduler_add(struct turtile_scheduler *scheduler,
+                   struct turtile_task *task);
+
+/**
+ * Unschedules a task, for instance before freeing it.
+ *
+ * @param task The task to unschedule.
+ */
+void scheduler_cancel(struct turtile_task *task);
+
+/**
+ * Checks whether a task deadline has passed.
+ *
+ * @param deadline The deadline given to the task, may be NULL.
+ * @return true if the task should stop.
+ */
+bool task_deadline_passed(const struct timespec *deadline);
+
+#endif // TURTILE_SCHEDULER_H
@@ -27,9 +27,11 @@
 #include "src/output.h"
 #include "toplevel.h"
 #include "popup.h"
+#include "snapshot.h"
 #include "wlr/util/box.h"
 #include "wlr/types/wlr_output_layout.h"
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_shell.h>
@@ -91,6 +93,10 @@ void server_new_xdg_toplevel(struct wl_listener *listener, void *data) {
 	wl_signal_add(&xdg_toplevel->events.request_maximize, &toplevel->request_maximize);
 	toplevel->request_fullscreen.notify = xdg_toplevel_request_fullscreen;
 	wl_signal_add(&xdg_toplevel->events.request_fullscreen, &toplevel->request_fullscreen);
+	toplevel->set_title.notify = xdg_toplevel_set_title;
+	wl_signal_add(&xdg_toplevel->events.set_title, &toplevel->set_title);
+	toplevel->set_app_id.notify = xdg_toplevel_set_app_id;
+	wl_signal_add(&xdg_toplevel->events.set_app_id, &toplevel->set_app_id);
 }
 
 void server_new_xdg_popup(struct wl_listener *listener, void *data) {
@@ -161,6 +167,12 @@ void tile(struct turtile_server *server) {
 }
 
 void server_redraw_windows(struct turtile_server *server) {
+	if (server->transaction_depth > 0) {
+		server->redraw_pending = true;
+		return;
+	}
+	server->redraw_pending = false;
+
 	struct turtile_toplevel *toplevel;
 	wl_list_for_each(toplevel, &server->toplevels, link) {
 		if (toplevel->workspace == server->active_workspace) {
@@ -171,4 +183,41 @@ void server_redraw_windows(struct turtile_server *server) {
 
 	}
 	tile(server);
+	// Focus changes redraw too, so this keeps the focus order current as well
+	snapshot_update(server);
+}
+
+void server_begin_transaction(struct turtile_server *server) {
+	server->transaction_depth++;
+}
+
+void server_commit_transaction(struct turtile_server *server) {
+	if (--server->transaction_depth > 0)
+		return;
+
+	struct turtile_toplevel *focus = server->pending_focus;
+	server->pending_focus = NULL;
+	if (focus)
+		focus_toplevel(focus, focus->xdg_toplevel->base->surface);
+
+	// focus_toplevel() may have redrawn already
+	if (server->redraw_pending)
+		server_redraw_windows(server);
+}
+
+uint64_t server_bump_generation(struct turtile_server *server) {
+	return ++server->generation;
+}
+
+void server_record_removed_window(struct turtile_server *server, const char *id) {
+	struct turtile_removed_window *removed =
+		&server->removed_windows[server->removed_windows_next];
+
+	// Overwriting the oldest removal, clients older than it need a full list
+	if (removed->generation > server->removed_windows_horizon)
+		server->removed_windows_horizon = removed->generation;
+	snprintf(removed->id, sizeof(removed->id), "%s", id);
+	removed->generation = server_bump_generation(server);
+	server->removed_windows_next =
+		(server->removed_windows_next + 1) % REMOVED_WINDOWS_MAX;
 }
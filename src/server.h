@@ -23,9 +23,24 @@
 #ifndef TURTILE_SERVER_H
 #define TURTILE_SERVER_H
 
+#include "reload.h"
+#include "scheduler.h"
+#include "spawner.h"
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlroots-0.18/wlr/util/box.h>
 
+#define REMOVED_WINDOWS_MAX 64
+
+struct keybind_map;
+
+// A window that was unmapped, remembered so that window list --since can
+// report its removal
+struct turtile_removed_window {
+    char id[9];
+    uint64_t generation;
+};
+
 enum turtile_cursor_mode {
     TURTILE_CURSOR_PASSTHROUGH,
     TURTILE_CURSOR_MOVE,
@@ -39,6 +54,7 @@ struct turtile_server {
     struct wlr_allocator *allocator;
     struct wlr_scene *scene;
     struct wlr_scene_output_layout *scene_layout;
+    struct wlr_scene_rect *background;
 
     struct wlr_xdg_shell *xdg_shell;
     struct wl_listener new_xdg_toplevel;
@@ -62,6 +78,11 @@ struct turtile_server {
     struct wl_listener request_cursor;
     struct wl_listener request_set_selection;
     struct wl_list keyboards;
+    // Keybinds the next key press is matched against: those of the current
+    // mode, or those completing the chord pressed so far. NULL for the top
+    // level keybinds and when no chord is started.
+    struct keybind_map *keybind_mode;
+    struct keybind_map *keybind_chord;
     enum turtile_cursor_mode cursor_mode;
     struct turtile_toplevel *grabbed_toplevel;
     double grab_x, grab_y;
@@ -71,6 +92,27 @@ struct turtile_server {
     struct wlr_output_layout *output_layout;
     struct wl_list outputs;
     struct wl_listener new_output;
+
+    struct turtile_scheduler *scheduler;
+    struct turtile_spawner *spawner; // children started by the compositor
+    struct turtile_config_watch *config_watch; // NULL unless reload_on_change
+    struct turtile_socket_server *socket_server;
+    struct turtile_task title_task; // sends the pending title events
+    struct turtile_task workspace_task; // destroys removed workspaces left empty
+    struct turtile_snapshot *snapshot; // NULL until a client asks for it
+
+    // Bumped on every change visible to IPC clients, windows keep the
+    // generation of their last change
+    uint64_t generation;
+    struct turtile_removed_window removed_windows[REMOVED_WINDOWS_MAX];
+    size_t removed_windows_next; // ring index of the oldest removal
+    uint64_t removed_windows_horizon; // older removals have been forgotten
+
+    int pending_configures; // windows yet to commit their layout configure
+
+    int transaction_depth; // > 0 while layout and focus updates are deferred
+    bool redraw_pending;
+    struct turtile_toplevel *pending_focus;
 };
 
 /**
@@ -107,4 +149,40 @@ void server_new_xdg_popup(struct wl_listener *listener, void *data);
  * @param server The server instance whose windows will be redrawn.
  */
 void server_redraw_windows(struct turtile_server *server);
+
+/**
+ * Starts a transaction. Until the matching server_commit_transaction() the
+ * state of windows and workspaces can be changed freely, but redraws and
+ * keyboard focus changes are only recorded. Transactions can be nested.
+ *
+ * @param server The server instance.
+ */
+void server_begin_transaction(struct turtile_server *server);
+
+/**
+ * Ends a transaction. When the outermost transaction is committed the last
+ * focused window receives keyboard focus and the windows are redrawn once,
+ * so clients receive at most one configure for the whole transaction.
+ *
+ * @param server The server instance.
+ */
+void server_commit_transaction(struct turtile_server *server);
+
+/**
+ * Starts a new state generation, to be called on every change visible to IPC
+ * clients (map, unmap, title, move, focus, workspace switch).
+ *
+ * @param server The server instance.
+ * @return The new generation.
+ */
+uint64_t server_bump_generation(struct turtile_server *server);
+
+/**
+ * Records the removal of a window in a new generation. Only the last
+ * REMOVED_WINDOWS_MAX removals are remembered.
+ *
+ * @param server The server instance.
+ * @param id The ID of the removed window.
+ */
+void server_record_removed_window(struct turtile_server *server, const char *id);
 #endif // TURTILE_SERVER_H
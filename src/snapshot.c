@@ -0,0 +1,203 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#define _GNU_SOURCE // memfd_create and mremap
+#include "snapshot.h"
+#include "src/toplevel.h"
+#include "src/workspace.h"
+#include "wlr/util/log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#define SNAPSHOT_MIN_SIZE 4096
+
+static struct turtile_snapshot *snapshot_create(void) {
+    struct turtile_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+    if (!snapshot)
+        return NULL;
+
+    snapshot->fd = memfd_create("turtile-snapshot",
+                                MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (snapshot->fd == -1) {
+        wlr_log(WLR_ERROR, "Failed to create snapshot: %s", strerror(errno));
+        free(snapshot);
+        return NULL;
+    }
+
+    // Clients can rely on the file never shrinking under their mapping
+    if (ftruncate(snapshot->fd, SNAPSHOT_MIN_SIZE) == -1 ||
+        fcntl(snapshot->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) == -1) {
+        wlr_log(WLR_ERROR, "Failed to set up snapshot: %s", strerror(errno));
+        close(snapshot->fd);
+        free(snapshot);
+        return NULL;
+    }
+
+    snapshot->data = mmap(NULL, SNAPSHOT_MIN_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, snapshot->fd, 0);
+    if (snapshot->data == MAP_FAILED) {
+        wlr_log(WLR_ERROR, "Failed to map snapshot: %s", strerror(errno));
+        close(snapshot->fd);
+        free(snapshot);
+        return NULL;
+    }
+    snapshot->size = SNAPSHOT_MIN_SIZE;
+
+    snapshot->data->magic = TURTILE_SNAPSHOT_MAGIC;
+    snapshot->data->version = TURTILE_SNAPSHOT_VERSION;
+    snapshot->data->size = snapshot->size;
+    snapshot->data->focused = TURTILE_SNAPSHOT_NONE;
+    return snapshot;
+}
+
+/**
+ * Grows the file and the mapping so that they can hold |size| bytes.
+ */
+static bool snapshot_reserve(struct turtile_snapshot *snapshot, size_t size) {
+    if (size <= snapshot->size)
+        return true;
+
+    size_t new_size = snapshot->size * 2;
+    while (new_size < size)
+        new_size *= 2;
+    if (new_size > UINT32_MAX || ftruncate(snapshot->fd, new_size) == -1) {
+        wlr_log(WLR_ERROR, "Failed to grow snapshot: %s", strerror(errno));
+        return false;
+    }
+
+    void *data = mremap(snapshot->data, snapshot->size, new_size,
+                        MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+        wlr_log(WLR_ERROR, "Failed to map snapshot: %s", strerror(errno));
+        return false;
+    }
+    snapshot->data = data;
+    snapshot->size = new_size;
+    return true;
+}
+
+static void copy_string(char *dest, size_t size, const char *src) {
+    snprintf(dest, size, "%s", src ? src : "");
+}
+
+void snapshot_update(struct turtile_server *server) {
+    struct turtile_snapshot *snapshot = server->snapshot;
+    if (!snapshot)
+        return;
+
+    size_t workspace_count = wl_list_length(&server->workspaces);
+    size_t window_count = wl_list_length(&server->toplevels);
+    size_t workspaces_offset = sizeof(struct turtile_snapshot_header);
+    size_t windows_offset = workspaces_offset +
+        workspace_count * sizeof(struct turtile_snapshot_workspace);
+    size_t focus_order_offset = windows_offset +
+        window_count * sizeof(struct turtile_snapshot_window);
+    if (!snapshot_reserve(snapshot, focus_order_offset +
+                          window_count * sizeof(uint32_t)))
+        return;
+
+    struct turtile_snapshot_header *header = snapshot->data;
+    char *base = (char *)header;
+
+    // Make the sequence odd before touching anything else
+    __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    header->size = snapshot->size;
+    header->workspace_count = workspace_count;
+    header->workspaces_offset = workspaces_offset;
+    header->window_count = window_count;
+    header->windows_offset = windows_offset;
+    header->focus_order_offset = focus_order_offset;
+
+    struct turtile_snapshot_workspace *workspaces =
+        (struct turtile_snapshot_workspace *)(base + workspaces_offset);
+    struct turtile_workspace *workspace;
+    wl_list_for_each(workspace, &server->workspaces, link) {
+        copy_string(workspaces->name, sizeof(workspaces->name),
+                    workspace->name);
+        workspaces->active = workspace == server->active_workspace;
+        workspaces++;
+    }
+
+    struct turtile_snapshot_window *windows =
+        (struct turtile_snapshot_window *)(base + windows_offset);
+    uint32_t index = 0;
+    struct turtile_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link) {
+        struct turtile_snapshot_window *window = &windows[index];
+        copy_string(window->id, sizeof(window->id), toplevel->id);
+        copy_string(window->app_id, sizeof(window->app_id),
+                    toplevel->xdg_toplevel->app_id);
+        copy_string(window->title, sizeof(window->title),
+                    toplevel->xdg_toplevel->title);
+        copy_string(window->workspace, sizeof(window->workspace),
+                    toplevel->workspace->name);
+        window->x = toplevel->geometry.x;
+        window->y = toplevel->geometry.y;
+        window->width = toplevel->geometry.width;
+        window->height = toplevel->geometry.height;
+        toplevel->snapshot_index = index++;
+    }
+
+    uint32_t *focus_order = (uint32_t *)(base + focus_order_offset);
+    wl_list_for_each(toplevel, &server->focus_toplevels, flink) {
+        *focus_order++ = toplevel->snapshot_index;
+    }
+
+    toplevel = get_first_focus_toplevel(server);
+    header->focused = toplevel ? toplevel->snapshot_index : TURTILE_SNAPSHOT_NONE;
+
+    __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELEASE);
+}
+
+int snapshot_open(struct turtile_server *server) {
+    if (!server->snapshot) {
+        server->snapshot = snapshot_create();
+        if (!server->snapshot)
+            return -1;
+        snapshot_update(server);
+    }
+
+    // A new open file description, so the client can't write through it
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", server->snapshot->fd);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        wlr_log(WLR_ERROR, "Failed to open snapshot: %s", strerror(errno));
+    return fd;
+}
+
+void snapshot_destroy(struct turtile_snapshot *snapshot) {
+    if (!snapshot)
+        return;
+
+    munmap(snapshot->data, snapshot->size);
+    close(snapshot->fd);
+    free(snapshot);
+}
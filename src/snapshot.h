@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_SNAPSHOT_H
+#define TURTILE_SNAPSHOT_H
+
+#include "server.h"
+#include "ipc.h"
+#include <stddef.h>
+
+/**
+ * Shared memory copy of the compositor state, see ipc.h for its layout.
+ */
+struct turtile_snapshot {
+    int fd; // memfd, writable, never handed out
+    struct turtile_snapshot_header *data;
+    size_t size; // size of the file and of the mapping
+};
+
+/**
+ * Opens a read-only file descriptor of the snapshot, to be handed to a
+ * client. The snapshot is created the first time a client asks for it, until
+ * then the compositor doesn't spend any time maintaining it.
+ *
+ * @param server The turtile server whose state is published.
+ * @return A new read-only file descriptor owned by the caller, or -1.
+ */
+int snapshot_open(struct turtile_server *server);
+
+/**
+ * Copies the current windows, workspaces and focus order to the snapshot.
+ * Does nothing if no client ever asked for the snapshot.
+ *
+ * @param server The turtile server whose state is published.
+ */
+void snapshot_update(struct turtile_server *server);
+
+/**
+ * Unmaps and closes the snapshot. Clients keep their own mappings.
+ *
+ * @param snapshot The snapshot to destroy, may be NULL.
+ */
+void snapshot_destroy(struct turtile_snapshot *snapshot);
+
+#endif // TURTILE_SNAPSHOT_H
@@ -20,6 +20,8 @@
    ----------------------------------------------------------------------------
 */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,26 +31,788 @@
 #include "socket_server.h"
 #include "server.h"
 #include "commands.h"
+#include "events.h"
+#include "output.h"
+#include "snapshot.h"
+#include "wlr/util/log.h"
 
 /**
- * Handle a client connection by receiving a command, executing it,
- * and sending a response.
+ * Called by the event loop when a client socket is readable, writable or has
+ * been closed by the peer.
  */
-void handle_client(int client_socket, struct turtile_context *context);
+static int handle_client_event(int fd, uint32_t mask, void *data);
 
-void* start_socket_server(void *context_ptr) {
-	struct turtile_context *context = (struct turtile_context *)context_ptr;
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void client_destroy(struct turtile_socket_client *client) {
+    scheduler_cancel(&client->task);
+    wl_event_source_remove(client->event_source);
+    close(client->fd);
+    wl_list_remove(&client->link);
+    for (int i = 0; i < client->nfds; i++)
+        close(client->fds[i].fd);
+    if (client->wait_fd != -1)
+        close(client->wait_fd);
+    if (client->wait_timer)
+        wl_event_source_remove(client->wait_timer);
+    buffer_finish(&client->in);
+    buffer_finish(&client->out);
+    buffer_finish(&client->held_events);
+    buffer_finish(&client->wait_result);
+    free(client);
+}
+
+/**
+ * Append a framed message to the output buffer of the client, growing it as
+ * needed. Either the whole frame is queued or nothing is. While the client
+ * runs a command its reply is being written to the output buffer, and while
+ * the wait command holds a reply the events caused by the command must
+ * follow it, so the frame is held back until the reply is queued.
+ */
+static bool client_queue_frame(struct turtile_socket_client *client,
+                               uint32_t id, const char *payload, size_t size) {
+    struct turtile_ipc_header header = {
+        .length = size,
+        .id = id,
+    };
+    struct turtile_buffer *buffer =
+        client->socket_server->running == client ||
+        client->wait_state != WAIT_NONE ?
+        &client->held_events : &client->out;
+
+    if (!buffer_reserve(buffer, sizeof(header) + size)) {
+        wlr_log(WLR_ERROR, "Failed to grow IPC output buffer");
+        return false;
+    }
+    buffer_append(buffer, &header, sizeof(header));
+    buffer_append(buffer, payload, size);
+    return true;
+}
+
+/**
+ * Attach a file descriptor to the reply being written, it is sent along with
+ * the first byte of the reply and closed once sent.
+ *
+ * @return false if too many file descriptors are waiting to be sent.
+ */
+static bool client_queue_fd(struct turtile_socket_client *client, int fd) {
+    if (client->nfds == MAX_PENDING_FDS ||
+        (client->nfds > 0 &&
+         client->fds[client->nfds - 1].offset == client->reply_start))
+        return false;
+
+    client->fds[client->nfds].fd = fd;
+    client->fds[client->nfds].offset = client->reply_start;
+    client->nfds++;
+    return true;
+}
+
+/**
+ * Send |size| bytes of the pending output, with |fd| as ancillary data unless
+ * it is -1.
+ */
+static ssize_t client_send(struct turtile_socket_client *client, size_t size,
+                           int fd) {
+    struct iovec iov = {
+        .iov_base = client->out.data + client->out_sent,
+        .iov_len = size,
+    };
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+
+    if (fd != -1) {
+        msg.msg_control = control.data;
+        msg.msg_controllen = sizeof(control.data);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+}
+
+/**
+ * Write as much of the pending output as the socket accepts without blocking.
+ *
+ * @return 1 if output is still pending, 0 if everything was written and -1 if
+ *         the connection failed.
+ */
+static int client_flush(struct turtile_socket_client *client) {
+    while (client->out_sent < client->out.len) {
+        // Stop right before the next file descriptor, so that it is attached
+        // to the right byte
+        size_t size = client->out.len - client->out_sent;
+        int fd = -1;
+        if (client->nfds > 0 && client->fds[0].offset == client->out_sent) {
+            fd = client->fds[0].fd;
+            if (client->nfds > 1)
+                size = client->fds[1].offset - client->out_sent;
+        } else if (client->nfds > 0) {
+            size = client->fds[0].offset - client->out_sent;
+        }
+
+        ssize_t n = client_send(client, size, fd);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            wlr_log(WLR_ERROR, "Failed to write to IPC client: %s",
+                    strerror(errno));
+            return -1;
+        }
+        client->out_sent += n;
+        if (fd != -1) {
+            close(fd);
+            memmove(client->fds, client->fds + 1,
+                    --client->nfds * sizeof(client->fds[0]));
+        }
+    }
+    client->out.len = client->out_sent = 0;
+    return 0;
+}
+
+/**
+ * Queue the events held while a reply was written, they follow it.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool client_queue_held_events(struct turtile_socket_client *client) {
+    if (client->held_events.len > 0)
+        buffer_append(&client->out, client->held_events.data,
+                      client->held_events.len);
+    client->held_events.len = 0;
+    client->held_events.failed = false; // the lost events were counted
+    if (client->out.failed) {
+        wlr_log(WLR_ERROR, "Failed to grow IPC output buffer");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Execute a request received from the client and queue the framed reply. The
+ * reply is serialized in place right after its header, whose length is filled
+ * in once the command is done.
+ */
+static bool client_handle_request(struct turtile_socket_client *client,
+                                  uint32_t id, char *command) {
+    struct turtile_ipc_header header = {
+        .id = id,
+    };
+    struct json_writer writer;
+
+    wlr_log(WLR_DEBUG, "Received command %u: %s", id, command);
+
+    size_t start = client->out.len;
+    client->reply_start = start;
+    buffer_append(&client->out, &header, sizeof(header));
+    json_writer_init(&writer, &client->out, client->encoding);
+
+    client->socket_server->running = client;
+    execute_command(command, &writer, &client->context);
+    client->socket_server->running = NULL;
+
+    if (client->out.failed) {
+        wlr_log(WLR_ERROR, "Failed to grow IPC output buffer");
+        return false;
+    }
+    if (client->wait_state != WAIT_NONE) {
+        // The wait command holds the reply, it is queued once the layout
+        // has been presented, along with its file descriptor and events
+        client->out.len = start;
+        client->wait_id = id;
+        if (client->nfds > 0 &&
+            client->fds[client->nfds - 1].offset == start)
+            client->wait_fd = client->fds[--client->nfds].fd;
+        return true;
+    }
+    header.length = client->out.len - start - sizeof(header);
+    memcpy(client->out.data + start, &header, sizeof(header));
+    return client_queue_held_events(client);
+}
+
+/**
+ * Whether a complete request is buffered and can be processed now.
+ */
+static bool client_has_request(struct turtile_socket_client *client) {
+    struct turtile_ipc_header header;
+
+    if (client->in.len < sizeof(header) ||
+        client->out.len - client->out_sent > MAX_PENDING_OUTPUT ||
+        client->wait_state != WAIT_NONE)
+        return false;
+    memcpy(&header, client->in.data, sizeof(header));
+    // A request too large is processed too, to reject it
+    return header.length > MAX_MSG_SIZE ||
+        client->in.len >= sizeof(header) + header.length;
+}
+
+/**
+ * Answer a request larger than MAX_MSG_SIZE with an error. The rest of the
+ * input can't be framed any more: it is dropped, and the connection is
+ * closed once the reply has been sent.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool client_reject_request(struct turtile_socket_client *client,
+                                  const struct turtile_ipc_header *request) {
+    struct turtile_ipc_header header = {
+        .id = request->id,
+    };
+    struct json_writer writer;
+
+    wlr_log(WLR_ERROR, "IPC request %u too large (%u bytes)",
+            request->id, request->length);
+
+    size_t start = client->out.len;
+    buffer_append(&client->out, &header, sizeof(header));
+    json_writer_init(&writer, &client->out, client->encoding);
+    reply_error(&writer, "request too large (%u bytes, at most %d)",
+                request->length, MAX_MSG_SIZE);
+    if (client->out.failed) {
+        wlr_log(WLR_ERROR, "Failed to grow IPC output buffer");
+        return false;
+    }
+    header.length = client->out.len - start - sizeof(header);
+    memcpy(client->out.data + start, &header, sizeof(header));
+
+    client->in.len = 0;
+    client->hangup = true;
+    return true;
+}
+
+/**
+ * Execute the complete requests in the input buffer, in the order they were
+ * received, until |deadline|. Processing pauses while the client is not
+ * reading its replies.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool client_process_input(struct turtile_socket_client *client,
+                                 const struct timespec *deadline) {
+    size_t offset = 0;
+
+    while (client->in.len - offset >= sizeof(struct turtile_ipc_header) &&
+           client->out.len - client->out_sent <= MAX_PENDING_OUTPUT &&
+           client->wait_state == WAIT_NONE) {
+        struct turtile_ipc_header header;
+        memcpy(&header, client->in.data + offset, sizeof(header));
+        if (header.length > MAX_MSG_SIZE)
+            return client_reject_request(client, &header);
+        size_t frame_size = sizeof(header) + header.length;
+        if (client->in.len - offset < frame_size)
+            break; // wait for the rest of the request
+
+        // The command is run in place, terminated over the next header or
+        // the spare byte of the buffer, which is restored afterwards
+        char *command = client->in.data + offset + sizeof(header);
+        char next = command[header.length];
+        command[header.length] = '\0';
+        offset += frame_size;
+
+        bool handled = client_handle_request(client, header.id, command);
+        client->in.data[offset] = next;
+        if (!handled)
+            return false;
+        if (task_deadline_passed(deadline))
+            break;
+    }
+
+    // Keep any partial request at the start of the buffer
+    memmove(client->in.data, client->in.data + offset, client->in.len - offset);
+    client->in.len -= offset;
+    return true;
+}
+
+/**
+ * Only poll for the events the client can currently make progress on.
+ */
+static void client_update_mask(struct turtile_socket_client *client) {
+    uint32_t mask = 0;
+    size_t pending = client->out.len - client->out_sent;
+
+    if (pending > 0)
+        mask |= WL_EVENT_WRITABLE;
+    if (!client->hangup && pending <= MAX_PENDING_OUTPUT &&
+        client->in.len < MAX_PENDING_INPUT)
+        mask |= WL_EVENT_READABLE;
+    wl_event_source_fd_update(client->event_source, mask);
+}
+
+/**
+ * Send what the client can take and schedule its pending requests. Requests
+ * are never run from the event handlers of the socket, so IPC can't delay the
+ * input and frames dispatched in the same iteration of the event loop.
+ *
+ * @return false if the client was destroyed.
+ */
+static bool client_dispatch(struct turtile_socket_client *client) {
+    if (client_flush(client) == -1) {
+        client_destroy(client);
+        return false;
+    }
+
+    bool has_request = client_has_request(client);
+    if (client->hangup && client->out.len == 0 &&
+        client->wait_state == WAIT_NONE && !has_request) {
+        client_destroy(client);
+        return false;
+    }
+    client_update_mask(client);
+    if (has_request)
+        scheduler_add(client->socket_server->server->scheduler, &client->task);
+    return true;
+}
+
+/**
+ * Runs the requests of the client within the IPC budget of the scheduler.
+ */
+static void client_run(struct turtile_task *task,
+                       const struct timespec *deadline) {
+    struct turtile_socket_client *client = wl_container_of(task, client, task);
+
+    if (!client_process_input(client, deadline)) {
+        client_destroy(client);
+        return;
+    }
+    client_dispatch(client);
+}
+
+static int handle_client_event(int fd, uint32_t mask, void *data) {
+    struct turtile_socket_client *client = data;
+
+    if (mask & WL_EVENT_READABLE) {
+        // The buffer grows with the request being received, and keeps a
+        // spare byte
+        size_t size = MAX_PENDING_INPUT - client->in.len;
+        if (size > SOCKET_READ_SIZE)
+            size = SOCKET_READ_SIZE;
+        if (!buffer_reserve(&client->in, size + 1)) {
+            wlr_log(WLR_ERROR, "Failed to grow IPC input buffer");
+            client_destroy(client);
+            return 0;
+        }
+        ssize_t n = recv(fd, client->in.data + client->in.len, size, 0);
+        if (n == 0) {
+            // The client is done sending, answer what is left and close
+            client->hangup = true;
+        } else if (n > 0) {
+            client->in.len += n;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            client_destroy(client);
+            return 0;
+        }
+    } else if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+        client_destroy(client);
+        return 0;
+    }
+
+    client_dispatch(client);
+    return 0;
+}
+
+bool socket_server_has_subscribers(struct turtile_socket_server *socket_server,
+                                   uint32_t type) {
+    if (!socket_server)
+        return false;
+
+    struct turtile_socket_client *client;
+    wl_list_for_each(client, &socket_server->clients, link) {
+        if (client->events & type)
+            return true;
+    }
+    return false;
+}
+
+uint32_t socket_server_subscriber_formats(
+    struct turtile_socket_server *socket_server, uint32_t type) {
+    uint32_t formats = 0;
+
+    if (!socket_server)
+        return 0;
+
+    struct turtile_socket_client *client;
+    wl_list_for_each(client, &socket_server->clients, link) {
+        if (client->events & type)
+            formats |= 1u << client->encoding;
+    }
+    return formats;
+}
+
+/**
+ * Tell the client how many events it missed since the last one delivered.
+ */
+static bool client_queue_overflow(struct turtile_socket_client *client) {
+    struct turtile_buffer buffer = {0};
+    struct json_writer writer;
+
+    json_writer_init(&writer, &buffer, client->encoding);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "event");
+    json_writer_string(&writer, "overflow");
+    json_writer_key(&writer, "dropped");
+    json_writer_int(&writer, client->events_dropped);
+    json_writer_end_object(&writer);
+
+    bool queued = !buffer.failed &&
+        client_queue_frame(client, 0, buffer.data, buffer.len);
+    buffer_finish(&buffer);
+    return queued;
+}
+
+void socket_server_broadcast(struct turtile_socket_server *socket_server,
+                             uint32_t type, enum json_writer_format format,
+                             const char *payload, size_t size) {
+    struct turtile_socket_client *client;
+    wl_list_for_each(client, &socket_server->clients, link) {
+        if (!(client->events & type) || client->encoding != format)
+            continue;
+
+        if (client->out.len - client->out_sent +
+            client->held_events.len > MAX_PENDING_EVENTS) {
+            client->events_dropped++;
+            continue;
+        }
+
+        if (client->events_dropped > 0 && client_queue_overflow(client))
+            client->events_dropped = 0;
+
+        if (client->events_dropped > 0 ||
+            !client_queue_frame(client, 0, payload, size)) {
+            client->events_dropped++;
+            continue;
+        }
+        // The client is flushed from the event loop, it may be the one
+        // currently running a command so it must not be destroyed here
+        client_update_mask(client);
+    }
+}
+
+/**
+ * Stream events of the given types (all of them by default) to the client.
+ */
+static void subscribe_command(char *tokens[], int ntokens,
+                              struct json_writer *response,
+                              struct turtile_context *context) {
+    if (context->client == NULL) {
+        reply_error(response, "subscribe is only available over the socket");
+        return;
+    }
+
+    uint32_t events = ntokens > 0 ? 0 : TURTILE_EVENT_ALL;
+    for (int i = 0; i < ntokens; i++) {
+        uint32_t type = event_type_from_name(tokens[i]);
+        if (type == 0) {
+            reply_error(response, "unknown event %s", tokens[i]);
+            return;
+        }
+        events |= type;
+    }
+
+    context->client->events |= events;
+    reply_success(response, "subscribed to events");
+}
+
+/**
+ * Switch the encoding of the following replies and events of the client.
+ */
+static void encoding_command(char *tokens[], int ntokens,
+                             struct json_writer *response,
+                             struct turtile_context *context) {
+    if (context->client == NULL) {
+        reply_error(response, "encoding is only available over the socket");
+        return;
+    }
+
+    if (ntokens < 1) {
+        reply_error(response, "missing argument: encoding");
+        return;
+    }
+
+    if (strcmp(tokens[0], "json") == 0) {
+        context->client->encoding = JSON_WRITER_TEXT;
+    } else if (strcmp(tokens[0], "msgpack") == 0) {
+        context->client->encoding = JSON_WRITER_MSGPACK;
+    } else {
+        reply_error(response, "unknown encoding %s", tokens[0]);
+        return;
+    }
+    reply_success(response, "encoding set to %s", tokens[0]);
+}
+
+/**
+ * Send the client a read-only file descriptor of the state snapshot.
+ */
+static void snapshot_command(char *tokens[], int ntokens,
+                             struct json_writer *response,
+                             struct turtile_context *context) {
+    if (context->client == NULL) {
+        reply_error(response, "snapshot is only available over the socket");
+        return;
+    }
+
+    int fd = snapshot_open(context->server);
+    if (fd == -1) {
+        reply_error(response, "failed to create the snapshot");
+        return;
+    }
+    if (!client_queue_fd(context->client, fd)) {
+        close(fd);
+        reply_error(response, "too many file descriptors pending");
+        return;
+    }
+
+    json_writer_begin_object(response);
+    json_writer_key(response, "success");
+    json_writer_string(response, "snapshot attached");
+    json_writer_key(response, "version");
+    json_writer_int(response, TURTILE_SNAPSHOT_VERSION);
+    json_writer_end_object(response);
+}
+
+/**
+ * Queue the held reply of the wait command and resume processing the
+ * requests of the client.
+ */
+static void client_finish_wait(struct turtile_socket_client *client,
+                               bool timed_out) {
+    struct turtile_ipc_header header = {
+        .id = client->wait_id,
+    };
+    struct json_writer writer;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ms = (now.tv_sec - client->wait_start.tv_sec) * 1000 +
+        (now.tv_nsec - client->wait_start.tv_nsec) / 1000000;
+
+    wl_event_source_remove(client->wait_timer);
+    client->wait_timer = NULL;
+    client->wait_state = WAIT_NONE;
+
+    size_t start = client->out.len;
+    client->reply_start = start;
+    buffer_append(&client->out, &header, sizeof(header));
+    json_writer_init(&writer, &client->out, client->encoding);
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "result");
+    json_writer_raw(&writer, client->wait_result.data, client->wait_result.len);
+    json_writer_key(&writer, "wait");
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "ms");
+    json_writer_int(&writer, ms);
+    json_writer_key(&writer, "timed_out");
+    json_writer_bool(&writer, timed_out);
+    json_writer_end_object(&writer);
+    json_writer_end_object(&writer);
+    client->wait_result.len = 0;
+
+    if (client->out.failed) {
+        wlr_log(WLR_ERROR, "Failed to grow IPC output buffer");
+        client_destroy(client);
+        return;
+    }
+    header.length = client->out.len - start - sizeof(header);
+    memcpy(client->out.data + start, &header, sizeof(header));
+    if (client->wait_fd != -1) {
+        if (!client_queue_fd(client, client->wait_fd))
+            close(client->wait_fd);
+        client->wait_fd = -1;
+    }
+    if (!client_queue_held_events(client)) {
+        client_destroy(client);
+        return;
+    }
+    client_dispatch(client);
+}
+
+static int handle_wait_timeout(void *data) {
+    struct turtile_socket_client *client = data;
+
+    wlr_log(WLR_DEBUG, "IPC request %u timed out waiting for the layout",
+            client->wait_id);
+    client_finish_wait(client, true);
+    return 0;
+}
 
-    int server_socket, client_socket;
+/**
+ * Run a command and hold its reply until the windows have committed the
+ * resulting layout and it has been shown by an output, or until the timeout.
+ * Usage: wait [--timeout MS] COMMAND...
+ */
+static void wait_command(char *tokens[], int ntokens,
+                         struct json_writer *response,
+                         struct turtile_context *context) {
+    struct turtile_socket_client *client = context->client;
+    int timeout = WAIT_TIMEOUT_MS;
+    char *command = ntokens > 0 ? tokens[0] : "";
+
+    if (client == NULL) {
+        reply_error(response, "wait is only available over the socket");
+        return;
+    }
+    // Only a whole reply can be held, not an element of a batch
+    if (response->depth > 0 || client->wait_state != WAIT_NONE) {
+        reply_error(response, "wait cannot be nested");
+        return;
+    }
+    if (strncmp(command, "--timeout", 9) == 0 &&
+        (command[9] == ' ' || command[9] == '\t')) {
+        char *end;
+        long value = strtol(command + 10, &end, 10);
+        if (end == command + 10 || value <= 0 || value > 60000) {
+            reply_error(response, "invalid timeout");
+            return;
+        }
+        timeout = value;
+        command = end + strspn(end, " \t\n");
+    }
+    if (*command == '\0') {
+        reply_error(response, "missing argument: command");
+        return;
+    }
+
+    struct wl_event_loop *loop =
+        wl_display_get_event_loop(context->server->wl_display);
+    client->wait_timer = wl_event_loop_add_timer(loop, handle_wait_timeout,
+                                                 client);
+    if (!client->wait_timer) {
+        reply_error(response, "failed to start the wait timer");
+        return;
+    }
+
+    struct json_writer writer;
+    client->wait_result.len = 0;
+    json_writer_init(&writer, &client->wait_result, client->encoding);
+    clock_gettime(CLOCK_MONOTONIC, &client->wait_start);
+    client->wait_state = WAIT_STARTING;
+    execute_command(command, &writer, context);
+    if (client->wait_result.failed) {
+        wl_event_source_remove(client->wait_timer);
+        client->wait_timer = NULL;
+        client->wait_state = WAIT_NONE;
+        client->wait_result.failed = false;
+        reply_error(response, "out of memory");
+        return;
+    }
+
+    wl_event_source_timer_update(client->wait_timer, timeout);
+    if (context->server->pending_configures > 0) {
+        client->wait_state = WAIT_CONFIGURE;
+    } else {
+        client->wait_state = WAIT_FRAME;
+        output_schedule_frames(context->server);
+    }
+}
+
+void socket_server_notify_configured(struct turtile_socket_server *socket_server) {
+    if (!socket_server)
+        return;
+
+    bool waiting = false;
+    struct turtile_socket_client *client;
+    wl_list_for_each(client, &socket_server->clients, link) {
+        if (client->wait_state == WAIT_CONFIGURE) {
+            client->wait_state = WAIT_FRAME;
+            waiting = true;
+        }
+    }
+    if (waiting)
+        output_schedule_frames(socket_server->server);
+}
+
+void socket_server_notify_frame(struct turtile_socket_server *socket_server) {
+    if (!socket_server)
+        return;
+
+    struct turtile_socket_client *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &socket_server->clients, link) {
+        if (client->wait_state == WAIT_FRAME)
+            client_finish_wait(client, false);
+    }
+}
+
+static int handle_server_event(int fd, uint32_t mask, void *data) {
+    struct turtile_socket_server *socket_server = data;
+
+    // Accept every pending connection, the listening socket is non-blocking
+    while (1) {
+        int client_fd = accept(fd, NULL, NULL);
+        if (client_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                wlr_log(WLR_ERROR, "Failed to accept client connection: %s",
+                        strerror(errno));
+            return 0;
+        }
+
+        if (set_nonblocking(client_fd) == -1 ||
+            fcntl(client_fd, F_SETFD, FD_CLOEXEC) == -1) {
+            wlr_log(WLR_ERROR, "Failed to set up client socket");
+            close(client_fd);
+            continue;
+        }
+
+        struct turtile_socket_client *client = calloc(1, sizeof(*client));
+        if (!client) {
+            wlr_log(WLR_ERROR, "Failed to allocate IPC client");
+            close(client_fd);
+            continue;
+        }
+        client->socket_server = socket_server;
+        client->fd = client_fd;
+        client->wait_fd = -1;
+        client->context.server = socket_server->server;
+        client->context.client = client;
+        turtile_task_init(&client->task, TASK_PRIORITY_IPC, client_run);
+
+        struct wl_event_loop *loop =
+            wl_display_get_event_loop(socket_server->server->wl_display);
+        client->event_source = wl_event_loop_add_fd(loop, client_fd,
+            WL_EVENT_READABLE, handle_client_event, client);
+        if (!client->event_source) {
+            wlr_log(WLR_ERROR, "Failed to add IPC client to the event loop");
+            close(client_fd);
+            free(client);
+            continue;
+        }
+        wl_list_insert(&socket_server->clients, &client->link);
+    }
+}
+
+struct turtile_socket_server *socket_server_create(struct turtile_server *server) {
     struct sockaddr_un server_address;
 
+    struct turtile_socket_server *socket_server =
+        calloc(1, sizeof(*socket_server));
+    if (!socket_server) {
+        wlr_log(WLR_ERROR, "Failed to allocate socket server");
+        return NULL;
+    }
+    socket_server->server = server;
+    wl_list_init(&socket_server->clients);
+
     // Remove socket if it already exists
     unlink(SOCKET_PATH);
 
-    server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (server_socket == -1) {
-        perror("Failed to create socket");
-        exit(EXIT_FAILURE);
+    socket_server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                               SOCK_CLOEXEC, 0);
+    if (socket_server->fd == -1) {
+        wlr_log(WLR_ERROR, "Failed to create socket: %s", strerror(errno));
+        free(socket_server);
+        return NULL;
     }
 
     memset(&server_address, 0, sizeof(server_address));
@@ -56,52 +820,54 @@ void* start_socket_server(void *context_ptr) {
     strncpy(server_address.sun_path, SOCKET_PATH,
 			sizeof(server_address.sun_path) - 1);
 
-    if (bind(server_socket, (struct sockaddr *)&server_address,
+    if (bind(socket_server->fd, (struct sockaddr *)&server_address,
 			 sizeof(server_address)) == -1) {
-        perror("Failed to bind socket");
-        close(server_socket);
-        exit(EXIT_FAILURE);
+        wlr_log(WLR_ERROR, "Failed to bind socket: %s", strerror(errno));
+        close(socket_server->fd);
+        free(socket_server);
+        return NULL;
     }
 
-    if (listen(server_socket, 5) == -1) {
-        perror("Failed to listen on socket");
-        close(server_socket);
-        exit(EXIT_FAILURE);
+    if (listen(socket_server->fd, SOMAXCONN) == -1) {
+        wlr_log(WLR_ERROR, "Failed to listen on socket: %s", strerror(errno));
+        close(socket_server->fd);
+        unlink(SOCKET_PATH);
+        free(socket_server);
+        return NULL;
     }
 
-    printf("Server listening on %s\n", SOCKET_PATH);
-
-    while (1) {
-        client_socket = accept(server_socket, NULL, NULL);
-        if (client_socket == -1) {
-            perror("Failed to accept client connection");
-            continue;
-        }
-
-        handle_client(client_socket, context);
+    struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+    socket_server->event_source = wl_event_loop_add_fd(loop, socket_server->fd,
+        WL_EVENT_READABLE, handle_server_event, socket_server);
+    if (!socket_server->event_source) {
+        wlr_log(WLR_ERROR, "Failed to add socket to the event loop");
+        close(socket_server->fd);
+        unlink(SOCKET_PATH);
+        free(socket_server);
+        return NULL;
     }
 
-    close(server_socket);
-    unlink(SOCKET_PATH);
-}
-
-void handle_client(int client_socket, struct turtile_context *context) {
-    char buffer[MAX_MSG_SIZE];
-    char response[MAX_MSG_SIZE];
+    // Commands that only make sense for socket clients
+    commands_register("subscribe", NULL, subscribe_command, 0);
+    commands_register("encoding", NULL, encoding_command, 0);
+    commands_register("snapshot", NULL, snapshot_command, 0);
+    commands_register("wait", NULL, wait_command, COMMAND_RAW_ARGS);
 
-    ssize_t bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_received > 0) {
-        buffer[bytes_received] = '\0'; // Null-terminate the command string
-        printf("Received command: %s\n", buffer);
+    wlr_log(WLR_INFO, "Server listening on %s", SOCKET_PATH);
+    return socket_server;
+}
 
-        execute_command(buffer, response, context);
-        ssize_t response_size = strlen(response);
+void socket_server_destroy(struct turtile_socket_server *socket_server) {
+    if (!socket_server)
+        return;
 
-        // send size
-        send(client_socket, &response_size, sizeof(response_size), 0);
-        // send response
-        send(client_socket, response, response_size, 0);
+    struct turtile_socket_client *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &socket_server->clients, link) {
+        client_destroy(client);
     }
 
-    close(client_socket);
+    wl_event_source_remove(socket_server->event_source);
+    close(socket_server->fd);
+    unlink(SOCKET_PATH);
+    free(socket_server);
 }
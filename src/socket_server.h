@@ -25,22 +25,160 @@
 
 #include "server.h"
 #include "commands.h"
+#include "ipc.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
-#define MAX_MSG_SIZE 1024 // max size of both commands and responses
-#define MAX_MSG_ELEMENTS 5 // max number of params in a command
-#define SOCKET_PATH "/tmp/turtile_socket"
+// stop reading requests from a client while this much output is unsent
+#define MAX_PENDING_OUTPUT (256 * 1024)
+// drop events for a subscriber while this much output is unsent
+#define MAX_PENDING_EVENTS (64 * 1024)
+#define MAX_PENDING_FDS 4 // file descriptors waiting to be sent to a client
+#define SOCKET_READ_SIZE 4096 // bytes read from a client at once
+// at most one full request is buffered
+#define MAX_PENDING_INPUT (sizeof(struct turtile_ipc_header) + MAX_MSG_SIZE)
+#define WAIT_TIMEOUT_MS 1000 // default timeout of the wait command
+
+// Progress of a command run by the wait command, whose reply is held back
+enum turtile_wait_state {
+    WAIT_NONE,
+    WAIT_STARTING, // running the command, so that it can't be a wait itself
+    WAIT_CONFIGURE, // for the windows to commit the configures of the layout
+    WAIT_FRAME, // for the next output frame
+};
+
+struct turtile_socket_server {
+    struct turtile_server *server;
+    int fd;
+    struct wl_event_source *event_source;
+    struct wl_list clients;
+    struct turtile_socket_client *running; // client whose command is running
+
+    uint64_t event_seq; // sequence number of the last event sent
+};
+
+struct turtile_socket_client {
+    struct wl_list link;
+    struct turtile_socket_server *socket_server;
+    int fd;
+    struct wl_event_source *event_source;
+    struct turtile_context context;
+    struct turtile_task task; // runs the buffered requests
+
+    // partially received requests, at most MAX_PENDING_INPUT bytes and a
+    // spare one to terminate the command in place. Its memory is kept
+    // between requests.
+    struct turtile_buffer in;
+
+    // pending bytes not yet accepted by the socket, replies are serialized
+    // straight into it and its memory is kept between requests
+    struct turtile_buffer out;
+    size_t out_sent;
+    // events raised while a reply is being written to |out| or held by the
+    // wait command, queued after it
+    struct turtile_buffer held_events;
+    size_t reply_start; // offset in |out| of the reply being written
+
+    // file descriptors sent along with the byte of |out| at |offset|
+    struct {
+        int fd;
+        size_t offset;
+    } fds[MAX_PENDING_FDS];
+    int nfds;
+
+    bool hangup; // the client closed its end, close after the last reply
+    enum json_writer_format encoding; // of replies and events, JSON by default
+
+    uint32_t events; // bitmask of subscribed turtile_event_type
+    uint64_t events_dropped; // events dropped since the last one delivered
+
+    // While waiting no other request of the client is processed
+    enum turtile_wait_state wait_state;
+    uint32_t wait_id; // request id of the held reply
+    struct turtile_buffer wait_result; // reply of the command, in |encoding|
+    struct timespec wait_start;
+    struct wl_event_source *wait_timer;
+    int wait_fd; // sent along with the held reply, -1 if none
+};
+
+/**
+ * Create the IPC socket server and add it to the Wayland event loop.
+ *
+ * This function creates a non-blocking Unix domain socket, binds it to
+ * SOCKET_PATH and listens for incoming connections. Clients are accepted and
+ * served from the event loop of the compositor, so commands always run on the
+ * same thread as the rest of the compositor. Connections stay open until the
+ * client closes them, and every framed request (see ipc.h) is answered in
+ * order on the same connection.
+ *
+ * @param server The turtile server whose event loop will serve the socket.
+ * @return The new socket server, or NULL if the socket could not be set up.
+ */
+struct turtile_socket_server *socket_server_create(struct turtile_server *server);
+
+/**
+ * Check whether any client is subscribed to the given type of events, so
+ * that events nobody listens to are not even built.
+ *
+ * @param socket_server The socket server, may be NULL.
+ * @param type A turtile_event_type bitmask.
+ * @return true if at least one client wants these events.
+ */
+bool socket_server_has_subscribers(struct turtile_socket_server *socket_server,
+                                   uint32_t type);
 
 /**
- * Start a socket server that listens for incoming client connections.
+ * Get the encodings used by the clients subscribed to the given type of
+ * events, so that each event is serialized once per encoding in use.
  *
- * This function creates a Unix domain socket, binds it to a specific path,
- * and listens for incoming connections.
+ * @param socket_server The socket server, may be NULL.
+ * @param type A turtile_event_type bitmask.
+ * @return A bitmask with bit (1 << format) set for each json_writer_format.
+ */
+uint32_t socket_server_subscriber_formats(
+    struct turtile_socket_server *socket_server, uint32_t type);
+
+/**
+ * Queue an event for every client subscribed to its type that uses the
+ * encoding of the event. Events are framed with request id 0. The compositor
+ * never waits for subscribers: while a client has more than
+ * MAX_PENDING_EVENTS bytes unread its events are dropped, and once it catches
+ * up it receives an "overflow" event with the number of events it missed, so
+ * it can query the full state again.
+ *
+ * @param socket_server The socket server.
+ * @param type The turtile_event_type of the event.
+ * @param format The encoding of the payload.
+ * @param payload The serialized event.
+ * @param size The size of the payload in bytes.
+ */
+void socket_server_broadcast(struct turtile_socket_server *socket_server,
+                             uint32_t type, enum json_writer_format format,
+                             const char *payload, size_t size);
+
+/**
+ * Tell the clients waiting for the layout that every window has committed
+ * the configure it was sent, so they now wait for the next frame.
+ *
+ * @param socket_server The socket server, may be NULL.
+ */
+void socket_server_notify_configured(struct turtile_socket_server *socket_server);
+
+/**
+ * Send the held replies of the clients waiting for a frame, to be called
+ * once an output has committed a frame.
+ *
+ * @param socket_server The socket server, may be NULL.
+ */
+void socket_server_notify_frame(struct turtile_socket_server *socket_server);
+
+/**
+ * Disconnect every client, remove the socket from the event loop and unlink
+ * it from the filesystem.
  *
- * @param context_ptr A context pointer of type turtile_context that is going
- *                    to be sent to the commands.
- * @return A void pointer for multithreading.
+ * @param socket_server The socket server to destroy.
  */
-void* start_socket_server(void *context_ptr);
+void socket_server_destroy(struct turtile_socket_server *socket_server);
 
 #endif // SOCKET_SERVER_H
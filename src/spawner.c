@@ -0,0 +1,178 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#include "spawner.h"
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "wlr/util/log.h"
+
+// Ancestors of a client looked at for the process that launched it, enough
+// for the shell and a wrapper script or two
+#define SPAWNER_MAX_ANCESTORS 8
+
+extern char **environ;
+
+static void process_destroy(struct turtile_process *process) {
+    wl_list_remove(&process->link);
+    free(process->cmd);
+    free(process);
+}
+
+static int handle_sigchld(int signal_number, void *data) {
+    struct turtile_spawner *spawner = data;
+    int status;
+    pid_t pid;
+
+    // Signals coalesce, reap every child that exited since the last one
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        struct turtile_process *process, *tmp;
+        wl_list_for_each_safe(process, tmp, &spawner->processes, link) {
+            if (process->pid != pid)
+                continue;
+            if (WIFEXITED(status))
+                wlr_log(WLR_DEBUG, "Process %d (%s) exited with status %d",
+                        pid, process->cmd, WEXITSTATUS(status));
+            else if (WIFSIGNALED(status))
+                wlr_log(WLR_DEBUG, "Process %d (%s) killed by signal %d",
+                        pid, process->cmd, WTERMSIG(status));
+            process_destroy(process);
+            break;
+        }
+    }
+    if (pid == -1 && errno != ECHILD)
+        wlr_log_errno(WLR_ERROR, "Failed to reap child processes");
+    return 0;
+}
+
+struct turtile_spawner *spawner_create(struct wl_event_loop *loop) {
+    struct turtile_spawner *spawner = calloc(1, sizeof(*spawner));
+    if (!spawner) {
+        wlr_log(WLR_ERROR, "Failed to allocate the spawner");
+        return NULL;
+    }
+    wl_list_init(&spawner->processes);
+
+    spawner->sigchld = wl_event_loop_add_signal(loop, SIGCHLD, handle_sigchld,
+                                                spawner);
+    if (!spawner->sigchld) {
+        wlr_log(WLR_ERROR, "Failed to watch SIGCHLD");
+        free(spawner);
+        return NULL;
+    }
+    return spawner;
+}
+
+void spawner_destroy(struct turtile_spawner *spawner) {
+    while (!wl_list_empty(&spawner->processes)) {
+        struct turtile_process *process =
+            wl_container_of(spawner->processes.next, process, link);
+        process_destroy(process);
+    }
+    wl_event_source_remove(spawner->sigchld);
+    free(spawner);
+}
+
+pid_t spawn_command(struct turtile_spawner *spawner, const char *cmd,
+                    struct turtile_workspace *workspace) {
+    struct turtile_process *process = calloc(1, sizeof(*process));
+    if (!process || !(process->cmd = strdup(cmd))) {
+        wlr_log(WLR_ERROR, "Failed to allocate the process of %s", cmd);
+        free(process);
+        return -1;
+    }
+
+    // The event loop blocks SIGCHLD to read it from a signalfd, give the
+    // child the signal mask and dispositions a shell expects
+    posix_spawnattr_t attr;
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                             POSIX_SPAWN_SETSIGDEF);
+
+    // posix_spawn shares the address space with the child until it execs,
+    // so the cost does not grow with the memory of the compositor
+    char *argv[] = {"/bin/sh", "-c", process->cmd, NULL};
+    int err = posix_spawn(&process->pid, "/bin/sh", NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        wlr_log(WLR_ERROR, "Failed to run %s: %s", cmd, strerror(err));
+        free(process->cmd);
+        free(process);
+        return -1;
+    }
+
+    process->started = time(NULL);
+    process->workspace = workspace;
+    wl_list_insert(spawner->processes.prev, &process->link);
+    wlr_log(WLR_DEBUG, "Started process %d: %s", process->pid, cmd);
+    return process->pid;
+}
+
+/**
+ * Reads the parent of a process from /proc.
+ *
+ * @return The parent pid, or -1 if the process is gone.
+ */
+static pid_t parent_pid(pid_t pid) {
+    char path[32], stat[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *file = fopen(path, "re");
+    if (!file)
+        return -1;
+    size_t size = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[size] = '\0';
+
+    // pid (comm) state ppid ..., comm may itself hold spaces and parentheses
+    char *end = strrchr(stat, ')');
+    pid_t ppid;
+    if (!end || sscanf(end + 1, " %*c %d", &ppid) != 1)
+        return -1;
+    return ppid;
+}
+
+struct turtile_workspace *spawner_claim_workspace(struct turtile_spawner *spawner,
+                                                  pid_t pid) {
+    for (int i = 0; i < SPAWNER_MAX_ANCESTORS && pid > 1; i++) {
+        struct turtile_process *process;
+        wl_list_for_each(process, &spawner->processes, link) {
+            if (process->pid == pid) {
+                struct turtile_workspace *workspace = process->workspace;
+                process->workspace = NULL;
+                return workspace;
+            }
+        }
+        pid = parent_pid(pid);
+    }
+    return NULL;
+}
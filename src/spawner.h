@@ -0,0 +1,95 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+#ifndef TURTILE_SPAWNER_H
+#define TURTILE_SPAWNER_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+struct turtile_workspace;
+
+/**
+ * A child process started by the compositor, tracked until it exits.
+ */
+struct turtile_process {
+    struct wl_list link; // turtile_spawner.processes, oldest first
+    pid_t pid;
+    char *cmd;
+    time_t started; // wall clock time of the spawn
+    // Workspace the process was launched for, where its first window goes.
+    // NULL once that window is mapped.
+    struct turtile_workspace *workspace;
+};
+
+/**
+ * Starts shell commands without forking the compositor and reaps them when
+ * they exit, from a SIGCHLD source of the event loop.
+ */
+struct turtile_spawner {
+    struct wl_list processes; // turtile_process.link
+    struct wl_event_source *sigchld;
+};
+
+/**
+ * Creates the spawner of an event loop. SIGCHLD is blocked from then on and
+ * delivered through the event loop instead.
+ *
+ * @param loop The event loop reaping the children.
+ * @return The spawner, or NULL on failure.
+ */
+struct turtile_spawner *spawner_create(struct wl_event_loop *loop);
+
+/**
+ * Destroys the spawner. Children still running are left alone and are no
+ * longer tracked.
+ *
+ * @param spawner The spawner to destroy.
+ */
+void spawner_destroy(struct turtile_spawner *spawner);
+
+/**
+ * Runs a command with /bin/sh -c in a new process.
+ *
+ * @param spawner The spawner tracking the process.
+ * @param cmd The command to run.
+ * @param workspace The workspace of the first window of the process, NULL to
+ *                  leave it on the active workspace.
+ * @return The pid of the process, or -1 on failure.
+ */
+pid_t spawn_command(struct turtile_spawner *spawner, const char *cmd,
+                    struct turtile_workspace *workspace);
+
+/**
+ * Finds the workspace a process or one of its ancestors was launched for, so
+ * that a window goes where it was launched from rather than wherever the user
+ * is when it maps. The launch workspace is only used for the first window.
+ *
+ * @param spawner The spawner.
+ * @param pid The pid of the client owning the window.
+ * @return The workspace, or NULL if the window goes to the active workspace.
+ */
+struct turtile_workspace *spawner_claim_workspace(struct turtile_spawner *spawner,
+                                                  pid_t pid);
+
+#endif // TURTILE_SPAWNER_H
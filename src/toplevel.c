@@ -21,7 +21,10 @@
 */
 
 #include "toplevel.h"
+#include "src/events.h"
 #include "src/server.h"
+#include "src/snapshot.h"
+#include "src/socket_server.h"
 #include "src/workspace.h"
 #include "wlr/util/log.h"
 #include <stdlib.h>
@@ -37,6 +40,22 @@ void focus_toplevel(struct turtile_toplevel *toplevel, struct wlr_surface *surfa
         return;
     }
     struct turtile_server *server = toplevel->server;
+	struct turtile_workspace *prev_workspace = server->active_workspace;
+	if (server->transaction_depth > 0) {
+		/* Inside a transaction only the focus order changes, the seat is
+		 * updated once when the transaction is committed. */
+		server->active_workspace = toplevel->workspace;
+		wl_list_remove(&toplevel->flink);
+		wl_list_insert(&server->focus_toplevels, &toplevel->flink);
+		server->pending_focus = toplevel;
+		server_bump_generation(server);
+		server_redraw_windows(server);
+		if (prev_workspace != server->active_workspace) {
+			emit_workspace_event(server, prev_workspace, server->active_workspace);
+			schedule_workspace_cleanup(prev_workspace);
+		}
+		return;
+	}
     struct wlr_seat *seat = server->seat;
     struct wlr_surface *prev_surface = seat->keyboard_state.focused_surface;
     if (prev_surface == surface) {
@@ -62,6 +81,7 @@ void focus_toplevel(struct turtile_toplevel *toplevel, struct wlr_surface *surfa
     /* Move the toplevel to the front */
 	wl_list_remove(&toplevel->flink);
 	wl_list_insert(&server->focus_toplevels, &toplevel->flink);
+	server_bump_generation(server);
     /* Activate the new surface */
     wlr_xdg_toplevel_set_activated(toplevel->xdg_toplevel, true);
     /*
@@ -74,6 +94,12 @@ void focus_toplevel(struct turtile_toplevel *toplevel, struct wlr_surface *surfa
             keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
     }
 	server_redraw_windows(server);
+
+	if (prev_workspace != server->active_workspace) {
+		emit_workspace_event(server, prev_workspace, server->active_workspace);
+		schedule_workspace_cleanup(prev_workspace);
+	}
+	emit_focus_event(server, toplevel);
 }
 
 void kill_toplevel(struct turtile_toplevel *toplevel) {
@@ -189,6 +215,18 @@ struct turtile_toplevel *desktop_toplevel_at(
     return tree->node.data;
 }
 
+/**
+ * Forget the layout configure of the toplevel, once it has been committed or
+ * the toplevel is gone, and tell waiting IPC clients when none is left.
+ */
+static void toplevel_configure_done(struct turtile_toplevel *toplevel) {
+	struct turtile_server *server = toplevel->server;
+
+	toplevel->configure_serial = 0;
+	if (--server->pending_configures == 0)
+		socket_server_notify_configured(server->socket_server);
+}
+
 void toplevel_resize(
         struct turtile_toplevel *toplevel, struct wlr_box geometry) {
 	toplevel->geometry = geometry;
@@ -199,10 +237,14 @@ void toplevel_resize(
 	const char *backend = getenv("TURTILE_BACKEND");
 	if(backend && strcmp(backend, "headless") == 0)
 		wlr_log(WLR_ERROR, "No resize on headless mode");
-	else 
-		wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel,
-								  toplevel->geometry.width,
-								  toplevel->geometry.height);
+	else {
+		uint32_t serial = wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel,
+													toplevel->geometry.width,
+													toplevel->geometry.height);
+		if (toplevel->configure_serial == 0)
+			toplevel->server->pending_configures++;
+		toplevel->configure_serial = serial;
+	}
 }
 
 void xdg_toplevel_map(struct wl_listener *listener, void *data) {
@@ -216,9 +258,32 @@ void xdg_toplevel_map(struct wl_listener *listener, void *data) {
     snprintf(short_uuid_str, sizeof(short_uuid_str), "%08x", *(uint32_t*)uuid);
     strncpy(toplevel->id, short_uuid_str, sizeof(toplevel->id));
 
-	toplevel->workspace = toplevel->server->active_workspace;
-    wl_list_insert(&toplevel->server->toplevels, &toplevel->link);
-    wl_list_insert(&toplevel->server->focus_toplevels, &toplevel->flink);
+	// Apps launched by turtile go to the workspace they were launched from,
+	// even if the user switched away while they started
+	struct turtile_server *server = toplevel->server;
+	pid_t pid;
+	wl_client_get_credentials(wl_resource_get_client(toplevel->xdg_toplevel->resource),
+							  &pid, NULL, NULL);
+	struct turtile_workspace *workspace =
+		spawner_claim_workspace(server->spawner, pid);
+	toplevel->workspace = workspace ? workspace : server->active_workspace;
+
+    wl_list_insert(&server->toplevels, &toplevel->link);
+	toplevel->created_generation = toplevel->generation =
+		server_bump_generation(server);
+
+	if (toplevel->workspace != server->active_workspace) {
+		// Focusing it would switch workspace, it waits hidden at the end of
+		// the focus order and is tiled once when its workspace is shown
+		wl_list_insert(server->focus_toplevels.prev, &toplevel->flink);
+		wlr_scene_node_set_enabled(&toplevel->scene_tree->node, false);
+		emit_window_event(server, "map", toplevel);
+		snapshot_update(server);
+		return;
+	}
+
+    wl_list_insert(&server->focus_toplevels, &toplevel->flink);
+	emit_window_event(server, "map", toplevel);
 
     focus_toplevel(toplevel, toplevel->xdg_toplevel->base->surface);
 }
@@ -235,8 +300,18 @@ void xdg_toplevel_unmap(struct wl_listener *listener, void *data) {
 		focus_toplevel(newfocus, newfocus->xdg_toplevel->base->surface);
     }
 
+	emit_window_event(toplevel->server, "unmap", toplevel);
+	server_record_removed_window(toplevel->server, toplevel->id);
+	if (toplevel->configure_serial)
+		toplevel_configure_done(toplevel);
+	toplevel->title_event_pending = false;
+	if (toplevel == toplevel->server->pending_focus)
+		toplevel->server->pending_focus = NULL;
+
     wl_list_remove(&toplevel->link);
     wl_list_remove(&toplevel->flink);
+	schedule_workspace_cleanup(toplevel->workspace);
+	snapshot_update(toplevel->server);
 }
 
 void xdg_toplevel_commit(struct wl_listener *listener, void *data) {
@@ -250,6 +325,13 @@ void xdg_toplevel_commit(struct wl_listener *listener, void *data) {
          * dimensions itself. */
         wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, 0, 0);
     }
+
+    /* The client committed the last configure of the layout, or a later one */
+    if (toplevel->configure_serial &&
+        (int32_t)(toplevel->xdg_toplevel->base->current.configure_serial -
+                  toplevel->configure_serial) >= 0) {
+        toplevel_configure_done(toplevel);
+    }
 }
 
 void xdg_toplevel_destroy(struct wl_listener *listener, void *data) {
@@ -264,6 +346,12 @@ void xdg_toplevel_destroy(struct wl_listener *listener, void *data) {
     wl_list_remove(&toplevel->request_resize.link);
     wl_list_remove(&toplevel->request_maximize.link);
     wl_list_remove(&toplevel->request_fullscreen.link);
+    wl_list_remove(&toplevel->set_title.link);
+    wl_list_remove(&toplevel->set_app_id.link);
+
+    for (int i = 0; i < JSON_WRITER_FORMATS; i++) {
+        buffer_finish(&toplevel->fragment[i]);
+    }
 
 	server_redraw_windows(toplevel->server);
     free(toplevel);
@@ -355,3 +443,27 @@ void xdg_toplevel_request_fullscreen(
         wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
     }
 }
+
+void xdg_toplevel_set_title(struct wl_listener *listener, void *data) {
+    /* Titles can change many times per second (e.g. terminals showing the
+     * running command), so the events are coalesced. Only mapped toplevels
+     * are known to IPC clients. */
+    struct turtile_toplevel *toplevel =
+        wl_container_of(listener, toplevel, set_title);
+    if (toplevel->xdg_toplevel->base->surface->mapped) {
+        schedule_title_event(toplevel);
+        toplevel->generation = server_bump_generation(toplevel->server);
+        snapshot_update(toplevel->server);
+    }
+}
+
+void xdg_toplevel_set_app_id(struct wl_listener *listener, void *data) {
+    /* No event is sent for it, but window lists and the snapshot show the
+     * app_id so they have to see the change. */
+    struct turtile_toplevel *toplevel =
+        wl_container_of(listener, toplevel, set_app_id);
+    if (toplevel->xdg_toplevel->base->surface->mapped) {
+        toplevel->generation = server_bump_generation(toplevel->server);
+        snapshot_update(toplevel->server);
+    }
+}
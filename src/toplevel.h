@@ -24,6 +24,7 @@
 #define TURTILE_TOPLEVEL_H
 
 #include "cursor.h"
+#include "json_writer.h"
 #include <wlr/types/wlr_xdg_shell.h>
 #include <uuid/uuid.h>
 
@@ -38,6 +39,15 @@ struct turtile_toplevel {
     struct wlr_scene_tree *scene_tree;
 	struct turtile_workspace *workspace;
     struct wlr_box geometry;
+    bool title_event_pending;
+    uint32_t snapshot_index; // position in the windows of the snapshot
+    uint64_t generation; // server generation of the last change
+    uint64_t created_generation; // server generation of the map
+    uint32_t configure_serial; // layout configure not yet committed, or 0
+    // The window serialized with the default fields in each encoding, valid
+    // while its generation is the generation of the toplevel
+    struct turtile_buffer fragment[JSON_WRITER_FORMATS];
+    uint64_t fragment_generation[JSON_WRITER_FORMATS];
 
     struct wl_listener map;
     struct wl_listener unmap;
@@ -47,6 +57,8 @@ struct turtile_toplevel {
     struct wl_listener request_resize;
     struct wl_listener request_maximize;
     struct wl_listener request_fullscreen;
+    struct wl_listener set_title;
+    struct wl_listener set_app_id;
 };
 
 /**
@@ -232,4 +244,22 @@ void xdg_toplevel_request_maximize(struct wl_listener *listener, void *data);
  */
 void xdg_toplevel_request_fullscreen(struct wl_listener *listener, void *data);
 
+/**
+ * This event is raised when a client sets the title of its toplevel.
+ *
+ * @param listener - The listener that triggered this callback.
+ * @param data - The data passed to the listener, which is the turtile
+ *         toplevel associated with the surface.
+ */
+void xdg_toplevel_set_title(struct wl_listener *listener, void *data);
+
+/**
+ * This event is raised when a client sets the app_id of its toplevel.
+ *
+ * @param listener - The listener that triggered this callback.
+ * @param data - The data passed to the listener, which is the turtile
+ *         toplevel associated with the surface.
+ */
+void xdg_toplevel_set_app_id(struct wl_listener *listener, void *data);
+
 #endif // TURTILE_TOPLEVEL_H
@@ -0,0 +1,499 @@
+/* ----------------------------------------------------------------------------
+   turtile - Simple Wayland compositor based on wlroots 
+   Copyright (C) 2024  Miguel López López
+
+   This file is part of turtile.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with this library; if not, see
+   <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------------
+*/
+
+/*
+ * Load generator for the IPC socket. It opens several connections to a
+ * running compositor, sends a weighted mix of commands, either as fast as
+ * replies come back or at a fixed rate, and reports the throughput and the
+ * latency distribution of each command.
+ *
+ * With a fixed rate, latency is measured from the time each request was
+ * scheduled rather than from the time it was actually sent, so a stalled
+ * compositor shows up in the percentiles instead of silently lowering the
+ * request rate.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ipc_client.h"
+
+#define MAX_CONNECTIONS 1024
+#define MAX_MIX 16 // max number of different commands
+#define MAX_WORKSPACES 64
+#define DRAIN_TIMEOUT_NS (5 * 1000000000ull) // wait for replies after the run
+
+// Latency histogram with 2^HISTOGRAM_SUB_BITS buckets per power of two,
+// which keeps the error of every reported value under 7%
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_BUCKETS (64 << HISTOGRAM_SUB_BITS)
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+struct bench_command {
+    char *command;
+    unsigned weight;
+    bool switch_workspace; // append the next workspace name to the command
+    uint64_t sent;
+    uint64_t errors; // replies with an "error" member
+    struct histogram latency;
+};
+
+struct pending_request {
+    uint64_t start; // when the request was scheduled, in nanoseconds
+    int command;    // index in the mix
+};
+
+struct bench_connection {
+    struct turtile_ipc_client *client;
+
+    // requests waiting for a reply, replies come back in order
+    struct pending_request *pending;
+    int pending_head;
+    int pending_count;
+};
+
+static struct bench_command mix[MAX_MIX];
+static int mix_len;
+static unsigned mix_weight; // sum of the weights of the mix
+static uint64_t mix_counter;
+
+static char *workspaces[MAX_WORKSPACES];
+static int workspace_count;
+static uint64_t workspace_counter;
+
+static int depth = 16; // max requests in flight per connection
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int histogram_bucket(uint64_t value) {
+    if (value < (1u << HISTOGRAM_SUB_BITS))
+        return value;
+
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) +
+        ((value >> shift) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+}
+
+/**
+ * Get the largest value that falls in a bucket.
+ */
+static uint64_t histogram_bucket_max(int bucket) {
+    if (bucket < (1 << HISTOGRAM_SUB_BITS))
+        return bucket;
+
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = bucket & ((1u << HISTOGRAM_SUB_BITS) - 1);
+    return (((1ull << HISTOGRAM_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+static void histogram_add(struct histogram *histogram, uint64_t value) {
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->total++;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+static void histogram_merge(struct histogram *into,
+                            const struct histogram *from) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->total += from->total;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+/**
+ * Get the value below which |percentile| percent of the samples fall.
+ */
+static uint64_t histogram_percentile(const struct histogram *histogram,
+                                     double percentile) {
+    uint64_t target = histogram->total * percentile / 100.0;
+    uint64_t seen = 0;
+
+    if (target >= histogram->total)
+        return histogram->max;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen > target) {
+            uint64_t value = histogram_bucket_max(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static const char *format_duration(uint64_t ns, char *buffer, size_t size) {
+    if (ns < 1000)
+        snprintf(buffer, size, "%" PRIu64 "ns", ns);
+    else if (ns < 1000000)
+        snprintf(buffer, size, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buffer, size, "%.2fms", ns / 1e6);
+    else
+        snprintf(buffer, size, "%.2fs", ns / 1e9);
+    return buffer;
+}
+
+/**
+ * Parse a mix like "window list:4,workspace switch:1" into |mix|.
+ */
+static bool parse_mix(char *spec) {
+    char *saveptr;
+    mix_len = 0;
+    mix_weight = 0;
+
+    for (char *entry = strtok_r(spec, ",", &saveptr); entry != NULL;
+         entry = strtok_r(NULL, ",", &saveptr)) {
+        if (mix_len == MAX_MIX) {
+            fprintf(stderr, "Too many commands in the mix\n");
+            return false;
+        }
+
+        unsigned weight = 1;
+        char *colon = strrchr(entry, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            weight = strtoul(colon + 1, NULL, 10);
+        }
+        if (weight == 0)
+            continue;
+
+        mix[mix_len].command = entry;
+        mix[mix_len].weight = weight;
+        mix[mix_len].switch_workspace = strcmp(entry, "workspace switch") == 0;
+        mix_weight += weight;
+        mix_len++;
+    }
+    return mix_len > 0;
+}
+
+/**
+ * Pick the next command of the mix. The choice is deterministic, so that
+ * every run sends the same sequence of commands.
+ */
+static int next_command(void) {
+    unsigned slot = mix_counter++ % mix_weight;
+    for (int i = 0; i < mix_len; i++) {
+        if (slot < mix[i].weight)
+            return i;
+        slot -= mix[i].weight;
+    }
+    return 0;
+}
+
+/**
+ * Fetch the workspace names used by "workspace switch" requests.
+ */
+static bool load_workspaces(void) {
+    struct turtile_ipc_client *client = ipc_client_connect(NULL);
+    struct turtile_ipc_message reply;
+    struct msgpack_reader reader;
+    struct msgpack_value list, value;
+
+    if (!client)
+        return false;
+    ipc_client_set_encoding(client, JSON_WRITER_MSGPACK);
+    if (!ipc_client_command(client, "workspace list --fields name", &reply) ||
+        reply.format != JSON_WRITER_MSGPACK) {
+        ipc_client_destroy(client);
+        return false;
+    }
+
+    // [{"name": "..."}, ...]
+    msgpack_reader_init(&reader, &reply);
+    if (msgpack_next(&reader, &list) && list.type == MSGPACK_ARRAY) {
+        for (uint32_t i = 0; i < list.count; i++) {
+            if (!msgpack_next(&reader, &value) || value.type != MSGPACK_MAP ||
+                value.count != 1 || !msgpack_next(&reader, &value) ||
+                !msgpack_next(&reader, &value) || value.type != MSGPACK_STR)
+                break;
+            if (workspace_count < MAX_WORKSPACES)
+                workspaces[workspace_count++] =
+                    strndup(value.str.data, value.str.size);
+        }
+    }
+    ipc_client_destroy(client);
+    return workspace_count > 0;
+}
+
+/**
+ * Append the next request of the mix to the output of the connection.
+ */
+static bool queue_request(struct bench_connection *connection,
+                          uint64_t start) {
+    int index = next_command();
+    struct bench_command *command = &mix[index];
+    char message[MAX_MSG_SIZE];
+    int length;
+
+    if (command->switch_workspace)
+        length = snprintf(message, sizeof(message), "%s %s", command->command,
+                          workspaces[workspace_counter++ % workspace_count]);
+    else
+        length = snprintf(message, sizeof(message), "%s", command->command);
+    if (length < 0 || length >= (int)sizeof(message))
+        return false;
+
+    if (ipc_client_queue(connection->client, message) == 0)
+        return false;
+
+    int tail = (connection->pending_head + connection->pending_count) % depth;
+    connection->pending[tail].start = start;
+    connection->pending[tail].command = index;
+    connection->pending_count++;
+    command->sent++;
+    return true;
+}
+
+/**
+ * Read the available replies and record their latency.
+ */
+static bool read_connection(struct bench_connection *connection) {
+    struct turtile_ipc_message message;
+
+    if (ipc_client_read(connection->client) == -1)
+        return false;
+
+    uint64_t now = now_ns();
+    while (ipc_client_next(connection->client, &message)) {
+        if (message.id == 0 || connection->pending_count == 0)
+            continue; // an event
+
+        struct pending_request *pending =
+            &connection->pending[connection->pending_head];
+        struct bench_command *command = &mix[pending->command];
+        histogram_add(&command->latency, now - pending->start);
+        if (ipc_message_is_error(&message))
+            command->errors++;
+        connection->pending_head = (connection->pending_head + 1) % depth;
+        connection->pending_count--;
+    }
+    return true;
+}
+
+static void print_row(const char *name, const struct histogram *latency,
+                      uint64_t errors) {
+    char p50[16], p99[16], p999[16], max[16];
+    printf("%-24s %10" PRIu64 " %8" PRIu64 " %10s %10s %10s %10s\n", name,
+           latency->total, errors,
+           format_duration(histogram_percentile(latency, 50), p50, sizeof(p50)),
+           format_duration(histogram_percentile(latency, 99), p99, sizeof(p99)),
+           format_duration(histogram_percentile(latency, 99.9), p999,
+                           sizeof(p999)),
+           format_duration(latency->max, max, sizeof(max)));
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-c connections] [-d seconds] [-r rate] [-p depth] "
+           "[-m mix]\n"
+           "  -c  concurrent connections (default 4)\n"
+           "  -d  duration of the run in seconds (default 10)\n"
+           "  -r  total requests per second, 0 sends a new request as soon "
+           "as a reply\n"
+           "      arrives (default 0)\n"
+           "  -p  max requests in flight per connection (default 16)\n"
+           "  -m  comma separated commands with their weight (default\n"
+           "      \"window list:4,workspace list:4,workspace switch:1,"
+           "window cycle:1\")\n"
+           "\"workspace switch\" cycles through every workspace. Run it "
+           "against a dedicated\ninstance, e.g. started with "
+           "TURTILE_BACKEND=headless.\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    int connection_count = 4;
+    double duration = 10;
+    double rate = 0;
+    char default_mix[] =
+        "window list:4,workspace list:4,workspace switch:1,window cycle:1";
+    char *mix_spec = default_mix;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:d:r:p:m:h")) != -1) {
+        switch (c) {
+        case 'c':
+            connection_count = atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'p':
+            depth = atoi(optarg);
+            break;
+        case 'm':
+            mix_spec = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (connection_count < 1 || connection_count > MAX_CONNECTIONS ||
+        depth < 1 || duration <= 0 || rate < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!parse_mix(mix_spec)) {
+        fprintf(stderr, "Invalid mix %s\n", mix_spec);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < mix_len; i++) {
+        if (mix[i].switch_workspace && !load_workspaces()) {
+            fprintf(stderr, "Failed to list the workspaces\n");
+            return EXIT_FAILURE;
+        }
+        if (mix[i].switch_workspace)
+            break;
+    }
+
+    struct bench_connection *connections =
+        calloc(connection_count, sizeof(*connections));
+    struct pollfd *fds = calloc(connection_count, sizeof(*fds));
+    if (!connections || !fds) {
+        perror("Failed to allocate connections");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < connection_count; i++) {
+        connections[i].client = ipc_client_connect(NULL);
+        connections[i].pending = calloc(depth, sizeof(struct pending_request));
+        if (!connections[i].client || !connections[i].pending) {
+            perror("Failed to connect to socket");
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t interval = rate > 0 ? 1e9 / rate : 0;
+    uint64_t start = now_ns();
+    uint64_t end = start + duration * 1e9;
+    uint64_t next_send = start;
+    int next_connection = 0;
+    int in_flight = 0;
+    uint64_t now;
+
+    while ((now = now_ns()) < end || in_flight > 0) {
+        if (now >= end + DRAIN_TIMEOUT_NS) {
+            fprintf(stderr, "Gave up waiting for %d replies\n", in_flight);
+            break;
+        }
+
+        if (now < end && interval == 0) {
+            // Closed loop, keep every connection busy
+            for (int i = 0; i < connection_count; i++) {
+                while (connections[i].pending_count < depth &&
+                       queue_request(&connections[i], now))
+                    in_flight++;
+            }
+        } else if (now < end) {
+            // Open loop, send every request that is due on the next
+            // connection with room for it, late requests keep their time
+            while (next_send <= now) {
+                int i, tries;
+                for (tries = 0; tries < connection_count; tries++) {
+                    i = next_connection++ % connection_count;
+                    if (connections[i].pending_count < depth)
+                        break;
+                }
+                if (tries == connection_count ||
+                    !queue_request(&connections[i], next_send))
+                    break;
+                in_flight++;
+                next_send += interval;
+            }
+        }
+
+        int timeout = 100;
+        if (now < end && interval > 0 && next_send > now)
+            timeout = (next_send - now + 999999) / 1000000;
+        for (int i = 0; i < connection_count; i++) {
+            if (ipc_client_flush(connections[i].client) == -1) {
+                perror("Failed to send request");
+                return EXIT_FAILURE;
+            }
+            fds[i].fd = connections[i].client->fd;
+            fds[i].events = POLLIN |
+                (ipc_client_pending(connections[i].client) ? POLLOUT : 0);
+        }
+
+        if (poll(fds, connection_count, timeout) == -1 && errno != EINTR) {
+            perror("Failed to poll");
+            return EXIT_FAILURE;
+        }
+        for (int i = 0; i < connection_count; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            int pending = connections[i].pending_count;
+            if (!read_connection(&connections[i])) {
+                fprintf(stderr, "Connection closed by the compositor\n");
+                return EXIT_FAILURE;
+            }
+            in_flight -= pending - connections[i].pending_count;
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    struct histogram total = {0};
+    uint64_t total_errors = 0;
+    printf("%d connections, %d in flight each, ", connection_count, depth);
+    if (interval)
+        printf("%.0f requests/s, %.2fs\n", rate, elapsed);
+    else
+        printf("closed loop, %.2fs\n", elapsed);
+    printf("%-24s %10s %8s %10s %10s %10s %10s\n", "command", "replies",
+           "errors", "p50", "p99", "p99.9", "max");
+    for (int i = 0; i < mix_len; i++) {
+        print_row(mix[i].command, &mix[i].latency, mix[i].errors);
+        histogram_merge(&total, &mix[i].latency);
+        total_errors += mix[i].errors;
+    }
+    print_row("total", &total, total_errors);
+    printf("throughput: %.0f replies/s\n", total.total / elapsed);
+
+    for (int i = 0; i < connection_count; i++) {
+        ipc_client_destroy(connections[i].client);
+        free(connections[i].pending);
+    }
+    free(connections);
+    free(fds);
+    for (int i = 0; i < workspace_count; i++)
+        free(workspaces[i]);
+    return in_flight > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
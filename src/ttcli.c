@@ -24,77 +24,192 @@
    ----------------------------------------------------------------------------
 */
 
-#include "json_tokener.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <sys/un.h>
 #include <unistd.h>
-#include <json-c/json.h>
+#include "ipc_client.h"
 
-#define MAX_MSG_SIZE 1024
-#define SOCKET_PATH "/tmp/turtile_socket"
+#define FILE_PIPELINE_DEPTH 64 // commands of a file sent ahead of the replies
 
-void print_json_object(json_object *obj, int indent) {
-    enum json_type type;
+/**
+ * Print a MessagePack value as indented text, one value per line.
+ */
+static bool print_msgpack_object(struct msgpack_reader *reader, int indent) {
+    struct msgpack_value value;
 
-    type = json_object_get_type(obj);
-    switch (type) {
-        case json_type_string:
-            printf("%s\n", json_object_get_string(obj));
-            break;
-        case json_type_int:
-            printf("%d\n", json_object_get_int(obj));
-            break;
-        case json_type_double:
-            printf("%f\n", json_object_get_double(obj));
-            break;
-        case json_type_boolean:
-            printf("%s\n", json_object_get_boolean(obj) ? "true" : "false");
-            break;
-	    case json_type_object: {
-            json_object_object_foreach(obj, key, obj2) {
-                printf("%*s%s: ", indent * 2, "", key);
-                print_json_object(obj2, indent + 1);
-            }
-            printf("%*s\n", indent * 2, "");
-            break;
-		
-	    }
-     	case json_type_array: {
-            int arraylen = json_object_array_length(obj);
-            for (int i = 0; i < arraylen; i++) {
-                printf("%*s", indent * 2, "");
-                print_json_object(json_object_array_get_idx(obj, i), indent + 1);
-            }
+    if (indent > IPC_CLIENT_MAX_DEPTH || !msgpack_next(reader, &value))
+        return false;
+
+    switch (value.type) {
+    case MSGPACK_NIL:
+        printf("null\n");
+        break;
+    case MSGPACK_BOOL:
+        printf("%s\n", value.boolean ? "true" : "false");
+        break;
+    case MSGPACK_INT:
+        printf("%" PRId64 "\n", value.integer);
+        break;
+    case MSGPACK_FLOAT:
+        printf("%f\n", value.real);
+        break;
+    case MSGPACK_STR:
+        printf("%.*s\n", (int)value.str.size, value.str.data);
+        break;
+    case MSGPACK_MAP:
+        for (uint32_t i = 0; i < value.count; i++) {
+            struct msgpack_value key;
+            if (!msgpack_next(reader, &key) || key.type != MSGPACK_STR)
+                return false;
+            printf("%*s%.*s: ", indent * 2, "", (int)key.str.size,
+                   key.str.data);
+            if (!print_msgpack_object(reader, indent + 1))
+                return false;
+        }
+        printf("%*s\n", indent * 2, "");
+        break;
+    case MSGPACK_ARRAY:
+        for (uint32_t i = 0; i < value.count; i++) {
             printf("%*s", indent * 2, "");
-            break;
+            if (!print_msgpack_object(reader, indent + 1))
+                return false;
         }
-        default:
-            printf("Unknown type\n");
-            break;
+        printf("%*s", indent * 2, "");
+        break;
     }
+    return true;
 }
 
-void process_command_output(const char *str, bool human_readable) {
-    struct json_object *parsed_json = json_tokener_parse(str);
+/**
+ * Print a reply, as indented text or as JSON text.
+ *
+ * @return false if the reply is malformed.
+ */
+static bool print_reply(const struct turtile_ipc_message *reply,
+                        bool human_readable) {
+    if (human_readable && reply->format == JSON_WRITER_MSGPACK) {
+        struct msgpack_reader reader;
+        msgpack_reader_init(&reader, reply);
+        if (print_msgpack_object(&reader, 0))
+            return true;
+        fprintf(stderr, "Malformed MessagePack reply\n");
+        return false;
+    }
 
-    if (human_readable && parsed_json != NULL) {
-        print_json_object(parsed_json, 0);
-    } else {
-        printf("%s", str);
+    struct turtile_buffer json = {0};
+    bool success = ipc_message_to_json(reply, &json);
+    if (success)
+        fwrite(json.data, 1, json.len, stdout);
+    else
+        fprintf(stderr, "Malformed MessagePack reply\n");
+    buffer_finish(&json);
+    return success;
+}
+
+/**
+ * Wait for the reply to the request |id| and print it, skipping events.
+ */
+static bool print_next_reply(struct turtile_ipc_client *client, uint32_t id,
+                             bool human_readable, bool newline) {
+    struct turtile_ipc_message reply;
+
+    do {
+        if (!ipc_client_recv(client, &reply)) {
+            perror("Failed to receive response");
+            return false;
+        }
+    } while (reply.id != id);
+
+    if (!print_reply(&reply, human_readable))
+        return false;
+    if (newline)
+        printf("\n");
+    return true;
+}
+
+/**
+ * Run every line of a file as a command over the connection, one reply per
+ * command. Commands are sent ahead of their replies, except when reading
+ * from a terminal where each reply is printed before reading the next line.
+ */
+static int run_file(struct turtile_ipc_client *client, const char *path,
+                    bool human_readable, bool wait) {
+    FILE *input = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!input) {
+        perror("Failed to open the command file");
+        return EXIT_FAILURE;
     }
+    bool interactive = isatty(fileno(input));
+
+    // Ids of the commands sent and not answered yet
+    uint32_t pending[FILE_PIPELINE_DEPTH];
+    int pending_head = 0, pending_count = 0;
+    char command[MAX_MSG_SIZE + 1];
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    int status = EXIT_SUCCESS;
+
+    while (status == EXIT_SUCCESS) {
+        if (interactive) {
+            printf("ttcli> ");
+            fflush(stdout);
+        }
+        if ((length = getline(&line, &line_size, input)) == -1)
+            break;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *start = line + strspn(line, " \t");
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        int size = snprintf(command, sizeof(command), "%s%s",
+                            wait ? "wait " : "", start);
+        uint32_t id = size <= MAX_MSG_SIZE ?
+            ipc_client_queue(client, command) : 0;
+        if (id == 0) {
+            fprintf(stderr, "Command too long: %s\n", start);
+            status = EXIT_FAILURE;
+            break;
+        }
+        pending[(pending_head + pending_count++) % FILE_PIPELINE_DEPTH] = id;
 
-    json_object_put(parsed_json);
+        while (pending_count == FILE_PIPELINE_DEPTH ||
+               (interactive && pending_count > 0)) {
+            if (!print_next_reply(client, pending[pending_head],
+                                  human_readable, !human_readable)) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            pending_head = (pending_head + 1) % FILE_PIPELINE_DEPTH;
+            pending_count--;
+        }
+        fflush(stdout);
+    }
+
+    // Print the replies still in flight
+    while (status == EXIT_SUCCESS && pending_count > 0) {
+        if (!print_next_reply(client, pending[pending_head], human_readable,
+                              !human_readable))
+            status = EXIT_FAILURE;
+        pending_head = (pending_head + 1) % FILE_PIPELINE_DEPTH;
+        pending_count--;
+    }
+
+    free(line);
+    if (input != stdin)
+        fclose(input);
+    return status;
 }
 
 int main(int argc, char *argv[]) {
-    int socket_fd;
-    struct sockaddr_un socket_address;
-    char message[MAX_MSG_SIZE];
+    char message[MAX_MSG_SIZE + 1];
     bool human_readable = true; // Flag to track if --json is passed
+    bool msgpack = false; // Flag to track if --msgpack is passed
+    bool wait = false; // Flag to track if --wait is passed
+    const char *file = NULL; // Commands file given with --file
 
     if (argc < 2) {
         // TODO: replace with help function
@@ -102,81 +217,93 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    // Check if the first argument is "--json"
+    // Parse the options preceding the command
     int arg_start = 1;
-    if (strcmp(argv[1], "--json") == 0) {
-        human_readable = false;
-        arg_start = 2; // Skip the --json argument
-        if (argc < 3) {
-            fprintf(stderr, "No command given after --json\n");
+    while (arg_start < argc && strncmp(argv[arg_start], "--", 2) == 0) {
+        if (strcmp(argv[arg_start], "--json") == 0) {
+            human_readable = false;
+        } else if (strcmp(argv[arg_start], "--msgpack") == 0) {
+            msgpack = true;
+        } else if (strcmp(argv[arg_start], "--wait") == 0) {
+            wait = true;
+        } else if (strcmp(argv[arg_start], "--file") == 0) {
+            if (++arg_start == argc) {
+                fprintf(stderr, "Missing file after --file\n");
+                return EXIT_FAILURE;
+            }
+            file = argv[arg_start];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[arg_start]);
             return EXIT_FAILURE;
         }
+        arg_start++;
     }
-
-    // Set up socket address
-    socket_address.sun_family = AF_UNIX;
-    strcpy(socket_address.sun_path, SOCKET_PATH);
-
-    // Create socket
-    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (socket_fd == -1) {
-        perror("Failed to create socket");
+    if (file && arg_start < argc) {
+        fprintf(stderr, "No command can be given with --file\n");
         return EXIT_FAILURE;
     }
-
-    // Connect to socket
-    if (connect(socket_fd, (struct sockaddr *)&socket_address,
-				sizeof(socket_address)) == -1) {
-        perror("Failed to connect to socket");
+    if (!file && arg_start >= argc) {
+        fprintf(stderr, "No command given after %s\n", argv[arg_start - 1]);
         return EXIT_FAILURE;
     }
 
-    // Build message from arguments, skipping --json if it was present
-    int message_len = 0;
-    for (int i = arg_start; i < argc; i++) {
-        if (i > arg_start) { // Add spaces between arguments
-            message_len += snprintf(message + message_len,
-									MAX_MSG_SIZE - message_len, " ");
-        }
-        message_len += snprintf(message + message_len,
-								MAX_MSG_SIZE - message_len, "%s", argv[i]);
-    }
-
-    // Send message
-    if (send(socket_fd, message, message_len, 0) == -1) {
-        perror("Failed to send message");
+    struct turtile_ipc_client *client = ipc_client_connect(NULL);
+    if (!client) {
+        perror("Failed to connect to socket");
         return EXIT_FAILURE;
     }
 
-    // Receive response size
-    ssize_t response_size;
-    if (recv(socket_fd, &response_size, sizeof(response_size), 0) <= 0) {
-        perror("Failed to receive response size");
-        return EXIT_FAILURE;
-    }
+    // Human readable output is printed from MessagePack, which is cheaper
+    // to decode. The encoding is switched without waiting for the reply.
+    if (msgpack || human_readable)
+        ipc_client_set_encoding(client, JSON_WRITER_MSGPACK);
 
-    // Allocate buffer for full response
-    char *response = malloc(response_size + 1);
-    if (!response) {
-        perror("Failed to allocate memory for response");
-        return EXIT_FAILURE;
-    }
+    int status = EXIT_SUCCESS;
+    if (file) {
+        status = run_file(client, file, human_readable, wait);
+    } else {
+        // Build message from arguments, skipping the options. With --wait
+        // the reply is only sent once the resulting layout is on screen
+        size_t message_len = wait ? snprintf(message, sizeof(message),
+                                             "wait ") : 0;
+        for (int i = arg_start; i < argc && message_len < sizeof(message);
+             i++) {
+            message_len += snprintf(message + message_len,
+                                    sizeof(message) - message_len, "%s%s",
+                                    i > arg_start ? " " : "", argv[i]);
+        }
 
-    // Receive full response
-    ssize_t total_received = 0;
-    while (total_received < response_size) {
-        ssize_t bytes_received = recv(socket_fd, response + total_received,
-                                      response_size - total_received, 0);
-        if (bytes_received <= 0) {
-            break;
+        struct turtile_ipc_message reply;
+        if (message_len > MAX_MSG_SIZE) {
+            fprintf(stderr, "Command too long\n");
+            status = EXIT_FAILURE;
+        } else if (!ipc_client_command(client, message, &reply)) {
+            perror("Failed to receive response");
+            status = EXIT_FAILURE;
+        } else if (!print_reply(&reply, human_readable)) {
+            status = EXIT_FAILURE;
+        } else if (strcmp(argv[arg_start], "subscribe") == 0 &&
+                   !ipc_message_is_error(&reply)) {
+            // A successful subscription streams events until the compositor
+            // exits
+            if (!human_readable)
+                printf("\n");
+            fflush(stdout);
+            while (ipc_client_recv(client, &reply)) {
+                print_reply(&reply, human_readable);
+                if (!human_readable)
+                    printf("\n");
+                fflush(stdout);
+            }
         }
-        total_received += bytes_received;
     }
-    response[total_received] = '\0'; // Null-terminate the response
-
-    process_command_output(response, human_readable);
 
-    free(response);
-    close(socket_fd);
-    return EXIT_SUCCESS;
+    // Without MessagePack human readable output falls back to JSON text
+    if (msgpack && status == EXIT_SUCCESS &&
+        client->encoding != JSON_WRITER_MSGPACK) {
+        fprintf(stderr, "MessagePack is not supported\n");
+        status = EXIT_FAILURE;
+    }
+    ipc_client_destroy(client);
+    return status;
 }
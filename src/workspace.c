@@ -22,7 +22,10 @@
 
 #include "workspace.h"
 #include "src/config.h"
+#include "src/events.h"
+#include "src/scheduler.h"
 #include "src/server.h"
+#include "src/snapshot.h"
 #include "src/toplevel.h"
 #include "wlr/util/log.h"
 #include <stdlib.h>
@@ -30,9 +33,9 @@
 #include <wayland-util.h> 
 
 struct turtile_workspace* create_workspace(struct turtile_server *server,
-										  char *name){
+										  const char *name){
 	struct turtile_workspace *new_workspace =
-		malloc(sizeof(struct turtile_workspace));
+		calloc(1, sizeof(struct turtile_workspace));
 	strcpy(new_workspace->name, name);
 	new_workspace->server = server;
 	
@@ -41,8 +44,64 @@ struct turtile_workspace* create_workspace(struct turtile_server *server,
 	return new_workspace;
 }
 
+void destroy_workspace(struct turtile_workspace *workspace) {
+	struct turtile_server *server = workspace->server;
+
+	// Launched apps that did not map yet go to the active workspace instead
+	struct turtile_process *process;
+	wl_list_for_each(process, &server->spawner->processes, link) {
+		if (process->workspace == workspace)
+			process->workspace = NULL;
+	}
+
+	wlr_log(WLR_INFO, "Destroy workspace: %s", workspace->name);
+	wl_list_remove(&workspace->link);
+	free(workspace);
+}
+
+bool workspace_has_windows(struct turtile_workspace *workspace) {
+	struct turtile_toplevel *toplevel;
+	wl_list_for_each(toplevel, &workspace->server->toplevels, link) {
+		if (toplevel->workspace == workspace)
+			return true;
+	}
+	return false;
+}
+
+static void handle_workspace_task(struct turtile_task *task,
+								  const struct timespec *deadline) {
+	struct turtile_server *server =
+		wl_container_of(task, server, workspace_task);
+	bool changed = false;
+
+	struct turtile_workspace *workspace, *tmp;
+	wl_list_for_each_safe(workspace, tmp, &server->workspaces, link) {
+		if (!workspace->removed || workspace == server->active_workspace ||
+			workspace_has_windows(workspace))
+			continue;
+		destroy_workspace(workspace);
+		changed = true;
+	}
+	if (changed) {
+		server_bump_generation(server);
+		snapshot_update(server);
+	}
+}
+
+void schedule_workspace_cleanup(struct turtile_workspace *workspace) {
+	// Destroyed from the scheduler, as callers may still use the workspace
+	if (workspace && workspace->removed && workspace->server->scheduler)
+		scheduler_add(workspace->server->scheduler,
+					  &workspace->server->workspace_task);
+}
+
+void workspaces_init(struct turtile_server *server) {
+	turtile_task_init(&server->workspace_task, TASK_PRIORITY_HOUSEKEEPING,
+					  handle_workspace_task);
+}
+
 struct turtile_workspace *get_workspace(struct turtile_server *server,
-										char *name) {
+										const char *name) {
 	struct turtile_workspace *workspace;
 	wl_list_for_each(workspace, &server->workspaces, link) {
 		if (strcmp(workspace->name, name) == 0) {
@@ -57,22 +116,30 @@ void switch_workspace(struct turtile_workspace *workspace){
 		return;
 	}
 	struct turtile_server *server = workspace->server;
+	struct turtile_workspace *prev_workspace = server->active_workspace;
 	server->active_workspace = workspace;
+	server_bump_generation(server);
 
 	struct turtile_toplevel *newfocus = get_first_focus_toplevel(server);
 	if(newfocus != NULL)
 		focus_toplevel(newfocus, newfocus->xdg_toplevel->base->surface);
 
 	server_redraw_windows(server);
+
+	if(prev_workspace != workspace) {
+		emit_workspace_event(server, prev_workspace, workspace);
+		schedule_workspace_cleanup(prev_workspace);
+	}
 }
 
 struct turtile_workspace* create_workspaces_from_config(struct turtile_server *server) {
-    turtile_workspace_config_t *workspace_config;
+	turtile_config_t *config = config_get_instance();
 
-	struct turtile_workspace *active_workspace;
+	struct turtile_workspace *active_workspace = NULL;
 
-    wl_list_for_each(workspace_config, &config_get_instance()->workspaces, link) {
-		active_workspace = create_workspace(server, workspace_config->name);
+	// Each one is inserted at the head, the first of the file ends up active
+	for (size_t i = config->workspace_count; i-- > 0;) {
+		active_workspace = create_workspace(server, config->workspaces[i].name);
 	}
 	return active_workspace; 
 }
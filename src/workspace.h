@@ -30,6 +30,7 @@ struct turtile_workspace {
 
 	char name[100];
 	struct turtile_server *server;
+	bool removed; // dropped from the config, destroyed once left empty
 	// TODO: add associated output for indendent workspaces in each display
 };
 
@@ -42,7 +43,39 @@ struct turtile_workspace {
  * @return A pointer to the newly created workspace, or NULL if the creation fails.
  */
 struct turtile_workspace* create_workspace(struct turtile_server *server,
-										  char *name);
+										  const char *name);
+
+/**
+ * Removes a workspace from the server's workspace list and frees it. The
+ * workspace must hold no window and must not be the active one.
+ *
+ * @param workspace The workspace to destroy.
+ */
+void destroy_workspace(struct turtile_workspace *workspace);
+
+/**
+ * Checks whether any mapped window is on a workspace.
+ *
+ * @param workspace The workspace.
+ * @return true if the workspace holds a window.
+ */
+bool workspace_has_windows(struct turtile_workspace *workspace);
+
+/**
+ * Schedules the destruction of a workspace removed from the config, which
+ * happens once it holds no window and is not the active one. Called whenever
+ * a window leaves the workspace or the workspace is left.
+ *
+ * @param workspace The workspace, may be NULL.
+ */
+void schedule_workspace_cleanup(struct turtile_workspace *workspace);
+
+/**
+ * Initializes the deferred work on the workspaces of the server.
+ *
+ * @param server The server.
+ */
+void workspaces_init(struct turtile_server *server);
 
 /**
  * Retrieves the workspace with the given name from the given server.
@@ -52,7 +85,7 @@ struct turtile_workspace* create_workspace(struct turtile_server *server,
  * @return A pointer to the workspace with the given name, or NULL
  */
 struct turtile_workspace *get_workspace(struct turtile_server *server,
-										char *name);
+										const char *name);
 /**
  * Switches the active workspace to the specified workspace.
  *
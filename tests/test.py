@@ -1,7 +1,12 @@
 import subprocess
 import json
+import mmap
+import socket
+import struct
 
 TTCLI = "./build/ttcli --json "
+SOCKET_PATH = "/tmp/turtile_socket"
+CONFIG_PATH = "tests/test.cfg" # loaded by the compositor under test
 
 def run_ttcli(command):
     """Run a ttcli command and return the result."""
@@ -25,12 +30,232 @@ def test_window_list(expected_titles):
     actual_titles = [{ "title": w["title"], "workspace": w["workspace"] } for w in windows]
     assert actual_titles == expected_titles, f"Expected {expected_titles} but got {actual_titles}"
 
+def test_list_filter(command, expected_output):
+    """Check that list filters and --fields return only what was asked for."""
+    result = run_ttcli(command)
+    actual_output = json.loads(result.stdout)
+    assert actual_output == expected_output, f"Expected {expected_output} but got {actual_output}"
+
+def test_window_delta():
+    """Check that window list --since only returns what changed."""
+    initial = json.loads(run_ttcli('window list --since 0').stdout)
+    generation = initial["generation"]
+    assert len(initial["added"]) == 2, f"Expected 2 added windows but got {initial}"
+
+    result = json.loads(run_ttcli(f'window list --since {generation}').stdout)
+    expected = { "generation": generation, "full": False, "added": [], "changed": [], "removed": [] }
+    assert result == expected, f"Expected {expected} but got {result}"
+
+    window_id = initial["added"][0]["id"]
+    run_ttcli(f'window move-to main {window_id}')
+    result = json.loads(run_ttcli(f'window list --since {generation} --fields id').stdout)
+    assert result["generation"] > generation, f"Expected a generation after {generation} but got {result}"
+    assert result["changed"] == [{ "id": window_id }], f"Expected {window_id} to be changed but got {result}"
+
+def test_tree(expected_workspaces):
+    """Check that tree agrees with window list and marks the master window."""
+    tree = json.loads(run_ttcli('tree').stdout)
+    windows = json.loads(run_ttcli('window list --fields id,title,geometry').stdout)
+    workspaces = [{ "name": w["name"], "active": w["active"],
+                    "titles": [t["title"] for t in w["windows"]] } for w in tree["workspaces"]]
+    assert workspaces == expected_workspaces, f"Expected {expected_workspaces} but got {workspaces}"
+
+    tree_windows = [{ key: t[key] for key in ("id", "title", "x", "y", "width", "height") }
+                    for w in tree["workspaces"] for t in w["windows"]]
+    assert tree_windows == windows, f"Expected {windows} but got {tree_windows}"
+    for w in tree["workspaces"]:
+        masters = [t["master"] for t in w["windows"]]
+        assert masters == [i == 0 for i in range(len(masters))], f"Expected the first window to be master in {w}"
+    focused = [t["id"] for w in tree["workspaces"] for t in w["windows"] if t["focused"]]
+    assert sorted(tree["focus_order"]) == sorted(t["id"] for t in windows), f"Expected every window in {tree['focus_order']}"
+    assert focused == tree["focus_order"][:1], f"Expected {tree['focus_order'][:1]} to be focused but got {focused}"
+
+def test_apply(state, expected_changes):
+    """Check that apply only makes the changes needed to reach the given state."""
+    result = json.loads(run_ttcli(f"apply '{json.dumps(state)}'").stdout)
+    expected = { "success": f"applied {expected_changes} changes" }
+    assert result == expected, f"Expected {expected} but got {result}"
+
+def test_apply_error(document, expected_error):
+    """Check that apply rejects an invalid state without changing anything."""
+    before = run_ttcli('window list --fields id,workspace').stdout
+    result = json.loads(run_ttcli(f"apply '{document}'").stdout)
+    expected = { "error": expected_error }
+    assert result == expected, f"Expected {expected} but got {result}"
+    assert run_ttcli('window list --fields id,workspace').stdout == before, "Expected no change"
+
+def test_apply_session(windows, missing_count):
+    """Check that a session document over 1 KiB is read whole, and that naming
+    a window that is gone changes nothing."""
+    before = json.loads(run_ttcli('window list --fields id,workspace').stdout)
+    missing = [f"{i:08x}" for i in range(missing_count)]
+    state = { "workspaces": {
+        "main": { "windows": windows + missing[0::2] },
+        "test": { "windows": missing[1::2] }
+    }, "active": "main" }
+    assert len(json.dumps(state)) > 1024, "Expected a session document over 1 KiB"
+    result = json.loads(run_ttcli(f"apply '{json.dumps(state)}'").stdout)
+    expected = { "error": f"window {missing[0]} not found" }
+    assert result == expected, f"Expected {expected} but got {result}"
+    after = json.loads(run_ttcli('window list --fields id,workspace').stdout)
+    assert after == before, f"Expected no change from {before} but got {after}"
+
+def test_wait(command):
+    """Check that --wait holds the reply until the layout has been shown."""
+    result = json.loads(run_ttcli('--wait ' + command).stdout)
+    assert "success" in result["result"], f"Expected a successful result but got {result}"
+    assert result["wait"]["timed_out"] is False, f"Expected no timeout but got {result}"
+
+def test_wait_nested(command):
+    """Check that a wait run by wait is refused while the outer one holds its reply."""
+    result = json.loads(run_ttcli(command).stdout)
+    expected = { "error": "wait cannot be nested" }
+    assert result["result"] == expected, f"Expected {expected} but got {result}"
+
+def test_file(commands):
+    """Check that --file runs every command over one connection, in order."""
+    result = subprocess.run(TTCLI.split() + ['--file', '-'], input='\n'.join(commands),
+                            capture_output=True, text=True)
+    replies = [json.loads(line) for line in result.stdout.splitlines()]
+    expected = [json.loads(run_ttcli(command).stdout) for command in commands]
+    assert replies == expected, f"Expected {expected} but got {replies}"
+
 def test_workspace_switch(destination_workspace):
     """Check workspace switch."""
     result = run_ttcli(f'workspace switch {destination_workspace}')
     expected_success_message = f'{{"success": "switch to workspace {destination_workspace}"}}'
     assert expected_success_message in result.stdout, f"Expected 'switch to workspace {destination_workspace}' in output, but got:\n{result.stdout}"
 
+def test_batch(commands, expected_results):
+    """Check that batch runs every command and returns one result for each."""
+    result = run_ttcli('batch ' + ' \\; '.join(commands))
+    results = json.loads(result.stdout)
+    assert results == expected_results, f"Expected {expected_results} but got {results}"
+
+def test_msgpack(command):
+    """Check that the MessagePack encoding carries the same reply as JSON."""
+    expected = json.loads(run_ttcli(command).stdout)
+    result = run_ttcli('--msgpack ' + command)
+    actual = json.loads(result.stdout)
+    assert actual == expected, f"Expected {expected} but got {actual}"
+
+def test_unknown_command(command):
+    """Check that unknown commands are reported as errors."""
+    result = run_ttcli(command)
+    expected = { "error": f"Unknown command {command.split()[0]}" }
+    assert json.loads(result.stdout) == expected, f"Expected {expected} but got:\n{result.stdout}"
+
+def test_process_list(expected_commands):
+    """Check that the processes started by the compositor are tracked."""
+    result = run_ttcli('process list')
+    processes = json.loads(result.stdout)
+    actual_commands = sorted(process["command"] for process in processes)
+    assert actual_commands == expected_commands, f"Expected {expected_commands} but got {actual_commands}"
+    assert all(process["pid"] > 0 for process in processes), f"Invalid pid in {processes}"
+
+def test_config_reload(expected_workspaces):
+    """Check that reloading an unchanged config keeps the workspaces."""
+    result = run_ttcli('config reload')
+    expected = { "success": "config reloaded" }
+    assert json.loads(result.stdout) == expected, f"Expected {expected} but got:\n{result.stdout}"
+    test_workspace_list(expected_workspaces)
+
+def window_workspaces():
+    """Return the workspace of each window, by id."""
+    windows = json.loads(run_ttcli('window list').stdout)
+    return { w["id"]: w["workspace"] for w in windows }
+
+def test_config_reload_changes(expected_workspaces, added_workspace):
+    """Check that reloading a changed config applies only the difference, and
+    that a broken config is refused without touching the running state."""
+    with open(CONFIG_PATH) as f:
+        original = f.read()
+    windows = window_workspaces()
+    changed = original.replace('"test"\n', f'"test",\n  "{added_workspace}"\n')
+    assert changed != original, "Expected the test config to list the test workspace last"
+
+    try:
+        with open(CONFIG_PATH, 'w') as f:
+            f.write(changed)
+        result = run_ttcli('config reload')
+        expected = { "success": "config reloaded" }
+        assert json.loads(result.stdout) == expected, f"Expected {expected} but got:\n{result.stdout}"
+        with_added = expected_workspaces + [{ "name": added_workspace, "active": False }]
+        test_workspace_list(with_added)
+        assert window_workspaces() == windows, f"Expected the windows to stay on {windows}"
+
+        with open(CONFIG_PATH, 'w') as f:
+            f.write(changed + '\nworkspaces = (\n')
+        result = json.loads(run_ttcli('config reload').stdout)
+        assert "error" in result, f"Expected an error for a broken config but got {result}"
+        test_workspace_list(with_added)
+        assert window_workspaces() == windows, f"Expected the windows to stay on {windows}"
+    finally:
+        with open(CONFIG_PATH, 'w') as f:
+            f.write(original)
+
+    # A workspace removed from the config stays while it holds a window
+    window, workspace = next(iter(windows.items()))
+    run_ttcli(f'window move-to {added_workspace} {window}')
+    run_ttcli('config reload')
+    test_workspace_list(with_added)
+    run_ttcli(f'window move-to {workspace} {window}')
+    test_workspace_list(expected_workspaces)
+    assert window_workspaces() == windows, f"Expected the windows to stay on {windows}"
+
+def recv_frame(sock):
+    header = sock.recv(8, socket.MSG_WAITALL)
+    length, frame_id = struct.unpack('II', header)
+    return frame_id, json.loads(sock.recv(length, socket.MSG_WAITALL))
+
+def test_events(first_workspace, second_workspace):
+    """Check that a subscriber gets the workspace events after the replies of
+    the commands that caused them, including a reply held by wait."""
+    commands = ['subscribe workspace',
+                f'workspace switch {first_workspace}',
+                f'wait workspace switch {second_workspace}']
+    with socket.socket(socket.AF_UNIX) as sock:
+        sock.connect(SOCKET_PATH)
+        for request_id, command in enumerate(commands, 1):
+            sock.sendall(struct.pack('II', len(command), request_id) +
+                         command.encode())
+        frames = [recv_frame(sock) for _ in range(5)]
+
+    ids = [frame_id for frame_id, _ in frames]
+    assert ids == [1, 2, 0, 3, 0], f"Expected replies before events but got {ids}"
+    events = [payload for frame_id, payload in frames if frame_id == 0]
+    assert [(e["event"], e["current"]) for e in events] == [
+        ("workspace", first_workspace), ("workspace", second_workspace)
+    ], f"Unexpected events {events}"
+    assert events[0]["seq"] < events[1]["seq"], f"Expected increasing seq in {events}"
+
+def test_snapshot(expected_titles):
+    """Check that the shared memory snapshot matches the window list."""
+    with socket.socket(socket.AF_UNIX) as sock:
+        sock.connect(SOCKET_PATH)
+        sock.sendall(struct.pack('II', len('snapshot'), 1) + b'snapshot')
+        header, fds, _, _ = socket.recv_fds(sock, 8, 1, socket.MSG_WAITALL)
+        length, _ = struct.unpack('II', header)
+        sock.recv(length, socket.MSG_WAITALL)
+    assert len(fds) == 1, "Expected the snapshot fd with the reply"
+
+    with mmap.mmap(fds[0], 0, prot=mmap.PROT_READ) as snapshot:
+        (magic, _, seq, _, _, _, window_count, windows_offset, _, _) = \
+            struct.unpack_from('10I', snapshot)
+        assert magic == 0x70736e74 and seq % 2 == 0, "Invalid snapshot header"
+
+        # id[16], app_id[128], title[256], workspace[128], x, y, width, height
+        window_format = '16s128s256s128s4i'
+        actual_titles = []
+        for i in range(window_count):
+            fields = struct.unpack_from(window_format, snapshot,
+                windows_offset + i * struct.calcsize(window_format))
+            actual_titles.append({
+                "title": fields[2].split(b'\0')[0].decode(),
+                "workspace": fields[3].split(b'\0')[0].decode()
+            })
+    assert actual_titles == expected_titles, f"Expected {expected_titles} but got {actual_titles}"
+
 if __name__ == '__main__':
     test_workspace_list([
         { "name": "main", "active": True },
@@ -40,7 +265,62 @@ if __name__ == '__main__':
         { "title": "simple-egl", "workspace": "main" },
         { "title": "simple-damage", "workspace": "main" }
     ])
+    test_snapshot([
+        { "title": "simple-egl", "workspace": "main" },
+        { "title": "simple-damage", "workspace": "main" }
+    ])
+    test_list_filter('window list --workspace main --fields title', [
+        { "title": "simple-egl" },
+        { "title": "simple-damage" }
+    ])
+    test_list_filter('window list --workspace test', [])
+    test_list_filter('workspace list --active --fields name', [
+        { "name": "main" }
+    ])
+    test_window_delta()
+    test_process_list(["weston-simple-damage", "weston-simple-egl"])
+    test_tree([
+        { "name": "main", "active": True, "titles": ["simple-egl", "simple-damage"] },
+        { "name": "test", "active": False, "titles": [] }
+    ])
+    windows = [w["id"] for w in json.loads(run_ttcli('window list --fields id').stdout)]
+    test_apply({ "workspaces": { "main": { "master": windows[0] } }, "active": "main" }, 0)
+    test_apply({ "workspaces": { "test": { "windows": [windows[1]] } } }, 1)
+    test_list_filter('window list --workspace test --fields id', [{ "id": windows[1] }])
+    test_apply({ "workspaces": { "main": { "windows": windows, "master": windows[0] } } }, 1)
+    test_apply_session(windows, 100)
+    test_apply_error(f'{{"workspaces": {{"main": {{"master": "{windows[0]}", "master": "{windows[1]}"}}}}}}',
+                     'workspace main has two masters')
+    test_file(['workspace list', 'window list --fields title', 'foo'])
+    test_msgpack('window list')
+    test_unknown_command('foo bar')
+    test_config_reload([
+        { "name": "main", "active": True },
+        { "name": "test", "active": False }
+    ])
+    test_config_reload_changes([
+        { "name": "main", "active": True },
+        { "name": "test", "active": False }
+    ], "extra")
     test_workspace_switch('test')
+    test_events('main', 'test')
+    test_workspace_list([
+        { "name": "main", "active": False },
+        { "name": "test", "active": True }
+    ])
+    test_wait('workspace switch main')
+    test_wait('workspace switch test')
+    test_wait_nested('wait wait workspace switch test')
+    test_wait_nested('wait --timeout 5 wait workspace switch test')
+    test_batch(['workspace switch main', 'workspace switch test'], [
+        { "success": "switch to workspace main" },
+        { "success": "switch to workspace test" }
+    ])
+    # A batch well over 1 KiB is a single request too
+    test_batch(['workspace switch main', 'workspace switch test'] * 100, [
+        { "success": "switch to workspace main" },
+        { "success": "switch to workspace test" }
+    ] * 100)
     test_workspace_list([
         { "name": "main", "active": False },
         { "name": "test", "active": True }